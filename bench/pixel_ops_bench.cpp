@@ -0,0 +1,213 @@
+#include "core/frame_ref.h"
+#include "core/pixel_ops.h"
+#include "ffmpeg/frame_converter.h"
+#include "ui/helpers.h"
+#include "logging.h"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+// Times the compositing kernels on a 4K canvas, with each instruction set
+// the CPU supports, against the code they replaced
+//
+// Usage: pixel_ops_bench [iterations]
+
+namespace ui
+{
+    // logging.cpp stamps messages with this, the app gets it from GLFW
+    core::timestamp now()
+    {
+        return core::time_cast<core::timestamp>(std::chrono::steady_clock::now().time_since_epoch());
+    }
+}
+
+static constexpr int canvas_width = 3840;
+static constexpr int canvas_height = 2160;
+
+static const char *simd_level_names[] = {"scalar", "sse4.1", "avx2"};
+
+static core::FrameRef make_frame(AVPixelFormat format, int width, int height)
+{
+    core::FrameRef frame{av_frame_alloc()};
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+
+    if (av_frame_get_buffer(frame.get(), 0) < 0)
+        throw std::runtime_error("av_frame_get_buffer");
+
+    return frame;
+}
+
+// Noise with every alpha value, so blending can't take shortcuts
+static void fill_noise(AVFrame *frame, int bpp)
+{
+    uint32_t state = 1;
+
+    for (int y = 0; y < frame->height; y++)
+    {
+        uint8_t *row = frame->data[0] + y * frame->linesize[0];
+
+        for (int x = 0; x < frame->width * bpp; x++)
+        {
+            state = state * 1664525 + 1013904223;
+            row[x] = state >> 24;
+        }
+    }
+}
+
+// Milliseconds per call, after a first call to warm up caches
+static double time_ms(int iterations, const std::function<void()> &fn)
+{
+    fn();
+
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; i++)
+        fn();
+
+    const auto elapsed = std::chrono::steady_clock::now() - begin;
+
+    return std::chrono::duration<double, std::milli>(elapsed).count() / iterations;
+}
+
+static void report(const std::string &name, double ms, double baseline_ms)
+{
+    fmt::print("  {:<32} {:9.3f} ms {:8.2f}x\n", name, ms, baseline_ms / ms);
+}
+
+// Run fn once per instruction set the CPU supports, with the kernels limited to it
+static void for_each_simd_level(const std::function<void(core::SimdLevel, const char*)> &fn)
+{
+    const auto supported = core::get_supported_simd_level();
+
+    for (int level = 0; level <= (int)supported; level++)
+    {
+        core::set_simd_level((core::SimdLevel)level);
+        fn((core::SimdLevel)level, simd_level_names[level]);
+    }
+
+    core::set_simd_level(supported);
+}
+
+// Per pixel copy the composer did before clipping once and working on rows,
+// with its bounds checks kept as they were, only moving 4 bytes per pixel
+// instead of RGB24's 3 so it works on the same frames as blit_rgba
+static void blit_pixels_reference(AVFrame *dst_frame, const AVFrame *src_frame, int dst_x, int dst_y)
+{
+    const auto dst_stride = dst_frame->linesize[0];
+    const auto src_stride = src_frame->linesize[0];
+    unsigned char *dst = dst_frame->data[0];
+    const unsigned char *src = src_frame->data[0];
+
+    for (int i = 0; i < src_frame->height; i++)
+    {
+        for (int j = 0; j < src_frame->width; j++)
+        {
+            int dst_i = i + dst_y;
+            int dst_j = j + dst_x;
+
+            if (dst_i < 0 || dst_i >= dst_frame->height)
+                continue;
+
+            if (dst_j < 0 || dst_j >= dst_frame->width)
+                continue;
+
+            dst[dst_i * dst_stride + dst_j * 4 + 0] = src[i * src_stride + j * 4 + 0];
+            dst[dst_i * dst_stride + dst_j * 4 + 1] = src[i * src_stride + j * 4 + 1];
+            dst[dst_i * dst_stride + dst_j * 4 + 2] = src[i * src_stride + j * 4 + 2];
+            dst[dst_i * dst_stride + dst_j * 4 + 3] = src[i * src_stride + j * 4 + 3];
+        }
+    }
+}
+
+static void bench_blit(int iterations)
+{
+    fmt::print("Canvas sized clip, {}x{}, partly off the canvas\n", canvas_width, canvas_height);
+
+    auto dst = make_frame(AV_PIX_FMT_RGBA, canvas_width, canvas_height);
+    auto src = make_frame(AV_PIX_FMT_RGBA, canvas_width, canvas_height);
+
+    fill_noise(src.get(), 4);
+    fill_noise(dst.get(), 4);
+
+    // Both copies are timed at an offset, so clipping has some work to do
+    const int x = -canvas_width / 8;
+    const int y = canvas_height / 8;
+
+    const double baseline = time_ms(iterations, [&] {
+        blit_pixels_reference(dst.get(), src.get(), x, y);
+    });
+
+    report("per pixel loop", baseline, baseline);
+
+    report("blit_rgba", time_ms(iterations, [&] {
+        core::blit_rgba(dst.get(), src.get(), x, y);
+    }), baseline);
+
+    for_each_simd_level([&](core::SimdLevel, const char *name) {
+        report(fmt::format("blend_over_rgba {}", name), time_ms(iterations, [&] {
+            core::blend_over_rgba(dst.get(), src.get(), x, y, 0.8f);
+        }), baseline);
+    });
+}
+
+static void bench_warp(int iterations)
+{
+    constexpr int clip_width = 1280;
+    constexpr int clip_height = 720;
+
+    // Enlarged to three quarters of the canvas, in the middle of it
+    constexpr int width = canvas_width * 3 / 4;
+    constexpr int height = canvas_height * 3 / 4;
+    constexpr int x = (canvas_width - width) / 2;
+    constexpr int y = (canvas_height - height) / 2;
+
+    fmt::print("{}x{} clip scaled to {}x{}\n", clip_width, clip_height, width, height);
+
+    auto dst = make_frame(AV_PIX_FMT_RGBA, canvas_width, canvas_height);
+    auto src = make_frame(AV_PIX_FMT_RGBA, clip_width, clip_height);
+
+    fill_noise(src.get(), 4);
+    fill_noise(dst.get(), 4);
+
+    const core::Rect canvas{0, 0, canvas_width, canvas_height};
+    ffmpeg::FrameConverter converter{AV_PIX_FMT_RGBA};
+
+    // What the composer did for every scaled clip before the warp
+    const double baseline = time_ms(iterations, [&] {
+        core::FrameRef scaled{converter.convert(src.get(), width, height)};
+        core::blend_over_rgba(dst.get(), scaled.get(), x, y, 0.8f);
+    });
+
+    report("swscale + blend_over_rgba", baseline, baseline);
+
+    for (const float degrees : {0.0f, 30.0f})
+    {
+        const auto map = core::place_rotated(clip_width, clip_height, x, y, width, height, degrees);
+
+        for_each_simd_level([&](core::SimdLevel, const char *name) {
+            report(fmt::format("warp_over_rgba {} {}deg", name, degrees), time_ms(iterations, [&] {
+                core::warp_over_rgba(dst.get(), src.get(), map, 0.8f, canvas);
+            }), baseline);
+        });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    logging::init();
+
+    const int iterations = (argc == 2)? std::max(1, std::atoi(argv[1])) : 20;
+
+    bench_blit(iterations);
+    bench_warp(iterations);
+
+    return 0;
+}
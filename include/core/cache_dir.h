@@ -0,0 +1,12 @@
+#pragma once
+
+#include <filesystem>
+
+namespace core
+{
+    // Root directory for data kept between runs, created on first use
+    //
+    // Defaults to $XDG_CACHE_HOME/ved or ~/.cache/ved and can
+    // be overridden with VED_CACHE_DIR
+    std::filesystem::path get_cache_dir();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <map>
+
+#include "core/frame_ref.h"
+#include "core/time.h"
+
+namespace core
+{
+    // Composed output frames of one VideoComposer, so that returning to an
+    // already composed position costs a lookup instead of a composition.
+    //
+    // Each position holds at most one frame, tagged with a key describing
+    // what it was composed from, a lookup with a different key misses.
+    // Memory use is bounded by a byte budget, least recently used frames
+    // are evicted first. Not thread safe, it belongs to a single composer.
+    class CompositionCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t hits{0};
+            uint64_t misses{0};
+            uint64_t evictions{0};
+            uint64_t invalidations{0};
+            size_t bytes{0};
+            size_t frames{0};
+        };
+
+        CompositionCache(size_t budget);
+
+        CompositionCache(const CompositionCache&) = delete;
+        CompositionCache &operator=(const CompositionCache&) = delete;
+
+        // New reference to the frame composed at ts from key, empty if there's none
+        FrameRef get(core::timestamp ts, uint64_t key);
+
+        void put(core::timestamp ts, uint64_t key, const FrameRef &frame);
+
+        // Drop the frames at positions within [begin, end]
+        void invalidate(core::timestamp begin, core::timestamp end);
+        void clear();
+
+        Stats get_stats() const;
+
+    private:
+        struct Entry
+        {
+            core::timestamp::rep ts;
+            uint64_t key;
+            FrameRef frame;
+            size_t bytes;
+        };
+
+        // Front holds the most recently used entry
+        using LruList = std::list<Entry>;
+
+        size_t _budget;
+        Stats _stats;
+        LruList _lru;
+
+        // Ordered, so edits can drop a whole range at once
+        std::map<core::timestamp::rep, LruList::iterator> _frames;
+
+        void erase(LruList::iterator it);
+        void evict();
+    };
+
+    // Budget for composers which memoize their output, taken from VED_COMPOSITION_CACHE_MB
+    size_t get_composition_cache_budget();
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core/frame_ref.h"
+#include "core/media_file.h"
+#include "core/media_source.h"
+#include "core/time.h"
+
+namespace core
+{
+    // Decoders shared by everything reading the same file
+    //
+    // Split clips and media reused across tracks would otherwise each open
+    // their own demuxer and decoder. Instead a decoder is leased for every
+    // fetch, picking the one which can reach the requested timestamp
+    // with the least decoding, up to a few decoders per file.
+    class DecoderPool
+    {
+    public:
+        // Decoder which remembers how far it got, so later frames are
+        // reached by decoding forward instead of seeking
+        class Decoder
+        {
+        public:
+            Decoder(core::MediaFile file);
+
+            Decoder(const Decoder&) = delete;
+            Decoder &operator=(const Decoder&) = delete;
+
+            bool is_open() const
+            {
+                return _source != nullptr;
+            }
+
+            // Frame with the lowest pts >= ts, empty past the end
+            FrameRef frame_at(core::timestamp ts);
+
+            // Plain access for callers positioning the decoder themselves
+            bool seek(core::timestamp ts);
+            FrameRef next_frame();
+
+            // How much has to be decoded to get to ts, max() if it needs a seek
+            core::timestamp distance_to(core::timestamp ts) const;
+
+        private:
+            core::MediaFile _file;
+            std::unique_ptr<core::MediaSource> _source;
+
+            // Last decoded frame, it's the one to show for ts in (_prev_fetch_ts, _last_fetch_ts]
+            FrameRef _last_fetch_frame;
+            core::timestamp _prev_fetch_ts{0s};
+            core::timestamp _last_fetch_ts{0s};
+
+            std::optional<core::timestamp> find_seek_target(core::timestamp ts) const;
+            std::pair<FrameRef, int> skip_frames_until(core::timestamp ts);
+        };
+
+        // Exclusive use of a decoder, returned to the pool on destruction
+        class Lease
+        {
+        public:
+            Lease() = default;
+            Lease(DecoderPool *pool, std::string path, Decoder *decoder);
+            Lease(Lease &&other);
+            ~Lease();
+
+            Lease &operator=(Lease &&other);
+
+            explicit operator bool() const
+            {
+                return _decoder != nullptr;
+            }
+
+            Decoder *operator->() const
+            {
+                return _decoder;
+            }
+
+        private:
+            DecoderPool *_pool{nullptr};
+            std::string _path;
+            Decoder *_decoder{nullptr};
+
+            void release();
+        };
+
+        // Upper bound of decoders open for a single file
+        static constexpr size_t max_file_decoders = 4;
+
+        DecoderPool() = default;
+
+        DecoderPool(const DecoderPool&) = delete;
+        DecoderPool &operator=(const DecoderPool&) = delete;
+
+        // Blocks while all decoders of the file are leased, the lease
+        // is empty if the file can't be opened
+        Lease acquire(const core::MediaFile &file, core::timestamp ts);
+
+        // Decoders of a file stay open while it has users
+        void add_user(const std::string &path);
+        void remove_user(const std::string &path);
+
+    private:
+        struct Entry
+        {
+            std::unique_ptr<Decoder> decoder;
+            bool leased{false};
+        };
+
+        struct FileDecoders
+        {
+            size_t users{0};
+
+            // Decoders being opened, counted towards the limit
+            size_t opening{0};
+
+            std::vector<Entry> decoders;
+        };
+
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::unordered_map<std::string, FileDecoders> _files;
+
+        void release(const std::string &path, Decoder *decoder);
+
+        // Drop the entry once the file has neither users nor decoders
+        void erase_if_unused(decltype(_files)::iterator it);
+    };
+
+    // Pool shared by the whole process
+    DecoderPool &get_decoder_pool();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "ffmpeg/headers.h"
+#include "core/frame_ref.h"
+#include "core/time.h"
+
+namespace core
+{
+    // Process wide store of decoded frames, shared by all SyncMediaSources
+    // reading the same file.
+    //
+    // Memory use is bounded by a byte budget, once it's exceeded the least
+    // recently used frames are evicted, skipping the ones pinned around
+    // the position each file is currently being read at. Frames buffered
+    // elsewhere can be charged to the same budget through reserve().
+    class FrameCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t hits{0};
+            uint64_t misses{0};
+            uint64_t evictions{0};
+            size_t bytes{0};
+            size_t frames{0};
+
+            // Set aside with reserve(), only in the totals
+            size_t reserved{0};
+        };
+
+        FrameCache(size_t budget);
+        ~FrameCache();
+
+        FrameCache(const FrameCache&) = delete;
+        FrameCache &operator=(const FrameCache&) = delete;
+
+        // Returns a new reference to the cached frame, empty if there's none
+        FrameRef get(const std::string &path, core::timestamp ts);
+
+        // Lookup which doesn't count towards the stats or recency
+        bool contains(const std::string &path, core::timestamp ts) const;
+
+        // Stores a reference to the frame, replacing the previous one at ts
+        void put(const std::string &path, core::timestamp ts, const FrameRef &frame);
+
+        // Protect frames within [center - radius, center + radius] from eviction
+        void pin(const std::string &path, core::timestamp center, core::timestamp radius);
+
+        // Set aside up to bytes of the budget for frames held outside of the
+        // cache, cached frames are evicted to make room. Grants at least
+        // min_bytes even once the budget is used up, give it back with release().
+        size_t reserve(size_t bytes, size_t min_bytes);
+        void release(size_t bytes);
+
+        void set_budget(size_t budget);
+        size_t get_budget() const;
+
+        Stats get_stats() const;
+        Stats get_file_stats(const std::string &path) const;
+
+    private:
+        struct FileEntry;
+
+        struct Entry
+        {
+            FileEntry *file;
+            core::timestamp::rep ts;
+            AVFrame *frame;
+            size_t bytes;
+        };
+
+        // Front holds the most recently used entry
+        using LruList = std::list<Entry>;
+
+        struct FileEntry
+        {
+            std::unordered_map<core::timestamp::rep, LruList::iterator> frames;
+            core::timestamp::rep pin_begin{0};
+            core::timestamp::rep pin_end{-1};
+            Stats stats;
+
+            bool is_pinned(core::timestamp::rep ts) const
+            {
+                return ts >= pin_begin && ts <= pin_end;
+            }
+        };
+
+        mutable std::mutex _mutex;
+        size_t _budget;
+        Stats _stats;
+        LruList _lru;
+        std::unordered_map<std::string, FileEntry> _files;
+
+        void erase(LruList::iterator it);
+        void evict();
+    };
+
+    // Cache shared by the whole process, budget is taken from VED_FRAME_CACHE_MB
+    FrameCache &get_frame_cache();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#include "ffmpeg/headers.h"
+
+namespace core
+{
+    // Owning handle to an AVFrame, freed once the handle goes away
+    //
+    // Handles are move-only, so every frame has exactly one owner at a time.
+    // The pixel buffers are reference counted by ffmpeg, share() hands out
+    // another handle to the same buffers without copying them.
+    class FrameRef
+    {
+    public:
+        FrameRef() = default;
+
+        explicit FrameRef(AVFrame *frame):
+            _frame(frame)
+        {
+        }
+
+        ~FrameRef()
+        {
+            av_frame_free(&_frame);
+        }
+
+        FrameRef(FrameRef &&other) noexcept:
+            _frame(std::exchange(other._frame, nullptr))
+        {
+        }
+
+        FrameRef &operator=(FrameRef &&other) noexcept
+        {
+            if (this != &other)
+            {
+                av_frame_free(&_frame);
+                _frame = std::exchange(other._frame, nullptr);
+            }
+
+            return *this;
+        }
+
+        FrameRef(const FrameRef&) = delete;
+        FrameRef &operator=(const FrameRef&) = delete;
+
+        // New handle to the same frame data
+        FrameRef share() const
+        {
+            return FrameRef{_frame? av_frame_clone(_frame) : nullptr};
+        }
+
+        AVFrame *get() const
+        {
+            return _frame;
+        }
+
+        AVFrame *operator->() const
+        {
+            return _frame;
+        }
+
+        explicit operator bool() const
+        {
+            return _frame != nullptr;
+        }
+
+        // Give up ownership, the caller has to free the frame
+        AVFrame *release()
+        {
+            return std::exchange(_frame, nullptr);
+        }
+
+        void reset()
+        {
+            av_frame_free(&_frame);
+        }
+
+    private:
+        AVFrame *_frame{nullptr};
+    };
+
+    // Bytes held by the buffers of frame, what caching it costs
+    inline size_t frame_size(const AVFrame *frame)
+    {
+        size_t size = 0;
+
+        for (const auto *buf : frame->buf)
+        {
+            if (buf)
+                size += buf->size;
+        }
+
+        return size;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "core/time.h"
+
+namespace core
+{
+    // Sorted presentation timestamps of the keyframes in a media file
+    //
+    // The index is filled in by a shared background worker after import,
+    // lookups made before it's complete only consider the keyframes found so far.
+    class KeyframeIndex
+    {
+    public:
+        using Builder = std::function<void(KeyframeIndex&)>;
+
+        KeyframeIndex() = default;
+        ~KeyframeIndex();
+
+        KeyframeIndex(const KeyframeIndex&) = delete;
+        KeyframeIndex &operator=(const KeyframeIndex&) = delete;
+
+        // Queue builder on the worker shared by all indexes, destroying
+        // the index drops it from the queue or cancels it and waits
+        void build_async(Builder builder);
+
+        void add(core::timestamp ts);
+        void finish();
+
+        bool is_complete() const
+        {
+            return _complete;
+        }
+
+        bool is_cancelled() const
+        {
+            return _cancelled;
+        }
+
+        size_t size() const;
+
+        // Latest keyframe at or before ts
+        std::optional<core::timestamp> keyframe_before(core::timestamp ts) const;
+
+        // Latest keyframe found so far
+        std::optional<core::timestamp> last_keyframe() const;
+
+    private:
+        mutable std::mutex _mutex;
+        std::vector<core::timestamp> _keyframes;
+
+        std::atomic<bool> _complete{false};
+        std::atomic<bool> _cancelled{false};
+        bool _building{false};
+    };
+}
@@ -2,11 +2,15 @@
 
 #include <string>
 #include <cstdint>
+#include <memory>
 
 #include "core/time.h"
+#include "core/keyframe_index.h"
 
 namespace core
 {
+    struct Proxy;
+
     struct MediaFile
     {
         enum Type
@@ -22,6 +26,15 @@ namespace core
 
         int width{-1};
         int height{-1};
+
+        // Whether frames may be see-through, assumed so until the file is probed
+        bool has_alpha{true};
+
+        // Shared between all copies of the file, empty for static images
+        std::shared_ptr<core::KeyframeIndex> keyframes;
+
+        // Set for files large enough to be previewed through a proxy
+        std::shared_ptr<core::Proxy> proxy;
     };
 }
 
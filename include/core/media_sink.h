@@ -3,6 +3,7 @@
 #include <string>
 
 #include "ffmpeg/headers.h"
+#include "core/frame_ref.h"
 #include "core/time.h"
 
 namespace core
@@ -13,7 +14,11 @@ namespace core
         virtual ~MediaSink() = default;
 
         virtual std::string get_name() = 0;
-        virtual void write_frame(AVMediaType frame_type, AVFrame *frame) = 0;
+
+        // Format video frames are encoded in, others get converted to it
+        virtual AVPixelFormat get_video_format() = 0;
+        // The sink takes its own references to whatever it keeps of the frame
+        virtual void write_frame(AVMediaType frame_type, const FrameRef &frame) = 0;
     };
 };
 
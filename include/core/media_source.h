@@ -3,6 +3,7 @@
 #include <string>
 
 #include "ffmpeg/headers.h"
+#include "core/frame_ref.h"
 #include "core/time.h"
 
 namespace core
@@ -17,7 +18,8 @@ namespace core
         virtual bool seek(core::timestamp position) = 0;
         virtual bool seek(int64_t byte_offset) = 0;
 
-        virtual AVFrame* next_frame(AVMediaType frame_type) = 0;
+        // Empty once there are no more frames
+        virtual FrameRef next_frame(AVMediaType frame_type) = 0;
         virtual bool has_stream(AVMediaType frame_type) = 0;
     };
 };
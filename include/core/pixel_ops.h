@@ -0,0 +1,107 @@
+#pragma once
+
+#include "ffmpeg/headers.h"
+
+#include <algorithm>
+
+namespace core
+{
+    // Part of a src_w x src_h image placed at (x, y) which lands on a dst_w x dst_h canvas
+    struct BlitRect
+    {
+        int src_x, src_y;
+        int dst_x, dst_y;
+        int width, height;
+
+        bool empty() const
+        {
+            return width <= 0 || height <= 0;
+        }
+    };
+
+    // Pixels [x0, x1) x [y0, y1)
+    struct Rect
+    {
+        int x0, y0;
+        int x1, y1;
+
+        bool empty() const
+        {
+            return x1 <= x0 || y1 <= y0;
+        }
+
+        Rect intersected(const Rect &other) const
+        {
+            return {std::max(x0, other.x0), std::max(y0, other.y0), std::min(x1, other.x1), std::min(y1, other.y1)};
+        }
+
+        // Smallest rect containing both, empty rects don't count
+        Rect united(const Rect &other) const
+        {
+            if (empty())
+                return other;
+
+            if (other.empty())
+                return *this;
+
+            return {std::min(x0, other.x0), std::min(y0, other.y0), std::max(x1, other.x1), std::max(y1, other.y1)};
+        }
+    };
+
+    // Maps destination pixel centers back to source texel coordinates,
+    // u = u0 + du_dx * x + du_dy * y, likewise for v
+    struct AffineMap
+    {
+        float u0, v0;
+        float du_dx, dv_dx;
+        float du_dy, dv_dy;
+    };
+
+    // Instruction sets the row kernels come in, ordered
+    enum class SimdLevel
+    {
+        scalar,
+        sse41,
+        avx2,
+    };
+
+    // Best the CPU supports, which is what's used unless limited below
+    SimdLevel get_supported_simd_level();
+
+    // Use kernels up to level only, to compare them against each other.
+    // Levels beyond what the CPU supports fall back to the supported one.
+    void set_simd_level(SimdLevel level);
+
+    BlitRect clip_blit_rect(int dst_w, int dst_h, int src_w, int src_h, int x, int y);
+
+    // Map for a src_w x src_h image scaled to width x height with its top left
+    // corner at (x, y), then rotated clockwise by degrees around its center
+    AffineMap place_rotated(int src_w, int src_h, int x, int y, int width, int height, float degrees);
+
+    // Bounding box of a width x height rect at (x, y), rotated as above
+    Rect rotated_bounds(int x, int y, int width, int height, float degrees);
+
+    // Narrow a rect down to the part landing within area of the destination
+    BlitRect clip_blit_area(BlitRect rect, const Rect &area);
+
+    // Set the area of an RGBA frame to transparent black
+    void clear_rgba(AVFrame *dst, const Rect &area);
+
+    // Copy an RGBA frame onto another with its top left corner at (x, y),
+    // parts outside of dst are cut off
+    void blit_rgba(AVFrame *dst, const AVFrame *src, int x, int y);
+
+    // Same as above, only touching the pixels of dst within area, so separate
+    // parts of dst can be written from different threads
+    void blit_rgba(AVFrame *dst, const AVFrame *src, int x, int y, const Rect &area);
+
+    // Composite a straight alpha RGBA frame over a premultiplied RGBA one,
+    // with the source alpha scaled by opacity in [0, 1]
+    void blend_over_rgba(AVFrame *dst, const AVFrame *src, int x, int y, float opacity);
+    void blend_over_rgba(AVFrame *dst, const AVFrame *src, int x, int y, float opacity, const Rect &area);
+
+    // Resample a straight alpha RGBA frame through map with bilinear filtering
+    // and composite it over the premultiplied RGBA dst, in one pass over the
+    // destination pixels within area
+    void warp_over_rgba(AVFrame *dst, const AVFrame *src, const AffineMap &map, float opacity, const Rect &area);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+
+#include "core/media_file.h"
+
+namespace core
+{
+    // Low resolution, intra-only copy of a media file used for previewing
+    //
+    // Shared between all copies of the original MediaFile, the ProxyManager
+    // updates it from its worker thread.
+    struct Proxy
+    {
+        enum Status
+        {
+            QUEUED,
+            GENERATING,
+            READY,
+            FAILED,
+        };
+
+        std::atomic<Status> status{QUEUED};
+        std::atomic<float> progress{0.0f};
+
+        // Only valid once READY
+        core::MediaFile media;
+
+        bool is_ready() const
+        {
+            return status == READY;
+        }
+    };
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "core/media_file.h"
+#include "core/proxy.h"
+
+namespace core
+{
+    // Generates proxies for imported files on a background thread
+    //
+    // Proxies are stored in the cache directory under a name derived from
+    // the path, size and modification time of the original, so they
+    // are reused across runs until the original changes.
+    class ProxyManager
+    {
+    public:
+        // Files at most this tall are previewed as they are
+        static constexpr int proxy_height = 540;
+
+        ProxyManager();
+        ~ProxyManager();
+
+        ProxyManager(const ProxyManager&) = delete;
+        ProxyManager &operator=(const ProxyManager&) = delete;
+
+        // Attach a proxy to the file and queue its generation if there's
+        // no up to date one on disk, files which don't need one are left alone
+        void request(core::MediaFile &file);
+
+    private:
+        struct Job
+        {
+            core::MediaFile file;
+            std::filesystem::path out_path;
+            std::shared_ptr<core::Proxy> proxy;
+        };
+
+        std::filesystem::path _dir;
+
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::deque<Job> _jobs;
+        std::atomic<bool> _stopped{false};
+
+        // Every proxy handed out so far, by original path
+        std::unordered_map<std::string, std::shared_ptr<core::Proxy>> _proxies;
+
+        std::thread _thread;
+
+        std::filesystem::path get_proxy_path(const std::string &path) const;
+        void run();
+        void generate(Job &job);
+    };
+}
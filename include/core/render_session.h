@@ -6,6 +6,10 @@
 #include "codec/codec.h"
 #include "core/video_properties.h"
 #include "ffmpeg/media_sink.h"
+
+#include "msd/channel.hpp"
+
+#include <atomic>
 #include <thread>
 
 namespace core
@@ -18,18 +22,41 @@ namespace core
         ffmpeg::SinkOptions::AudioStream audio;
     };
 
+    // Renders the timeline in three stages, each on a thread of its own:
+    // composing, converting to the encoder's format and encoding. Bounded
+    // queues between them let every stage work on a different frame, while
+    // a stage running ahead blocks once the next one falls behind.
     class RenderSession
     {
     public:
         RenderSession(core::Timeline &timeline, RenderSettings settings);
         ~RenderSession();
         
-        core::Event<AVFrame*> frame_ready_event;
+        // Frames are shared with the sink, take another reference to keep one
+        core::Event<const FrameRef&> frame_ready_event;
         core::Event<> finished_event;
 
     private:
+        // Frame as composed, and as handed to the encoder
+        struct EncodeJob
+        {
+            FrameRef composed;
+            FrameRef converted;
+        };
+
         core::VideoComposer _composer;
         std::unique_ptr<core::MediaSink> _sink;
-        std::thread _thread;
+
+        msd::channel<FrameRef> _composed_frames;
+        msd::channel<EncodeJob> _encode_jobs;
+        std::atomic<bool> _stopped{false};
+
+        std::thread _compose_thread;
+        std::thread _convert_thread;
+        std::thread _encode_thread;
+
+        void compose(core::timestamp duration);
+        void convert();
+        void encode();
     };
 }
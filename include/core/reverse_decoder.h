@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "ffmpeg/headers.h"
+#include "core/frame_ref.h"
+#include "core/media_file.h"
+#include "core/time.h"
+
+namespace core
+{
+    // Serves the frames of a file in backwards order
+    //
+    // Decoders only go forward, so frames are decoded one segment at a time,
+    // from a keyframe up to the requested timestamp, into a bounded buffer
+    // which is then drained in reverse. While a segment drains, the one
+    // preceding it is decoded on a background thread. Buffered segments
+    // are charged to the FrameCache budget.
+    class ReverseDecoder
+    {
+    public:
+        ReverseDecoder(core::MediaFile file);
+        ~ReverseDecoder();
+
+        // Frame with the lowest pts >= ts, empty if there's none
+        FrameRef frame_at(core::timestamp ts);
+
+    private:
+        struct Segment
+        {
+            // All frames with pts in [cover_begin, frames.back()->pts] are present
+            core::timestamp cover_begin{0s};
+            std::deque<FrameRef> frames;
+
+            // Taken from the frame cache budget for the frames of the segment
+            size_t reserved{0};
+
+            ~Segment();
+
+            bool covers(core::timestamp ts) const;
+            const FrameRef *find(core::timestamp ts) const;
+        };
+
+        using SegmentPtr = std::unique_ptr<Segment>;
+
+        struct Job
+        {
+            uint64_t generation;
+
+            // Decode up to and including the first frame at or past end
+            core::timestamp end;
+        };
+
+        core::MediaFile _file;
+
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::optional<Job> _job;
+        std::atomic<uint64_t> _generation{0};
+        uint64_t _done_generation{0};
+        bool _stopped{false};
+
+        // Segment being drained, and the one decoded before it
+        SegmentPtr _current;
+        SegmentPtr _prefetched;
+
+        std::thread _thread;
+
+        void run();
+        void submit_job(core::timestamp end);
+        void schedule_prefetch();
+        FrameRef serve(core::timestamp ts);
+        SegmentPtr decode_segment(const Job &job);
+    };
+}
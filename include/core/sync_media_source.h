@@ -2,27 +2,66 @@
 
 #include "core/media_source.h"
 #include "core/media_file.h"
+#include "core/proxy.h"
+#include "core/reverse_decoder.h"
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <memory>
+#include <optional>
 
 namespace core
 {
     class SyncMediaSource
     {
     public:
-        SyncMediaSource(core::MediaFile file);
+        // With prefer_proxy, decoding moves over to the proxy of the file
+        // as soon as it's ready
+        SyncMediaSource(core::MediaFile file, bool prefer_proxy = false);
+        ~SyncMediaSource();
 
-        AVFrame *frame_at(core::timestamp req_ts);
+        // Frame with the lowest pts >= req_ts, empty past the end
+        FrameRef frame_at(core::timestamp req_ts);
+
+        // Decode frames ahead of the last request on the worker shared by
+        // all sources, straight into the frame cache
+        void set_read_ahead(bool enabled);
 
     private:
+        // File being decoded, either the original or its proxy
         core::MediaFile _file;
-        std::unique_ptr<core::MediaSource> _raw_source;
+        std::shared_ptr<core::Proxy> _proxy;
+        bool _using_proxy{false};
+
+        std::unique_ptr<core::ReverseDecoder> _reverse_decoder;
         core::timestamp _last_req_ts{0s};
         core::timestamp _last_ret_ts{0s};
-        core::timestamp _last_fetch_ts{0s};
 
-        std::pair<AVFrame*, int> skip_frames_until(core::timestamp ts);
+        // Serializes decoding with the read-ahead worker, and guards
+        // _file against switching to the proxy meanwhile
+        std::mutex _decode_mutex;
+
+        // Read-ahead state, the worker fetches _read_ahead_ts next
+        // and stays at most _read_ahead_depth steps past the playhead.
+        // A source has at most one step queued or running at a time.
+        std::mutex _read_ahead_mutex;
+        std::atomic<uint64_t> _read_ahead_generation{0};
+        bool _read_ahead_enabled{false};
+        bool _read_ahead_queued{false};
+        core::timestamp _playhead{0s};
+        core::timestamp _read_ahead_ts{0s};
+        core::timestamp _read_ahead_step{0s};
+        size_t _read_ahead_depth;
+        size_t _read_ahead_hits{0};
+
+        void switch_to_proxy();
+        bool is_reverse_step(core::timestamp req_ts) const;
+        FrameRef decode_frame_at(core::timestamp ts);
+
+        void update_read_ahead(core::timestamp ts, bool cache_hit);
+        bool has_read_ahead_work() const;
+        void queue_read_ahead();
+        void read_ahead_step();
     };
 }
-
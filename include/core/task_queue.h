@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+    // Small set of worker threads running queued background tasks in order
+    //
+    // Unlike ThreadPool, callers don't wait for their tasks. Each task is
+    // tagged with its owner instead, which drops its tasks with remove()
+    // before going away.
+    class TaskQueue
+    {
+    public:
+        using Task = std::function<void()>;
+
+        TaskQueue(size_t num_threads);
+        ~TaskQueue();
+
+        TaskQueue(const TaskQueue&) = delete;
+        TaskQueue &operator=(const TaskQueue&) = delete;
+
+        void push(const void *owner, Task task);
+
+        // Drop the queued tasks of owner, and wait for those already running
+        void remove(const void *owner);
+
+    private:
+        struct Job
+        {
+            const void *owner;
+            Task task;
+        };
+
+        std::mutex _mutex;
+        std::condition_variable _jobs_cv;
+        std::condition_variable _done_cv;
+        std::deque<Job> _jobs;
+        std::vector<const void*> _running;
+        bool _stopped{false};
+
+        std::vector<std::thread> _threads;
+
+        void run();
+    };
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+    // Fixed set of worker threads for splitting CPU bound work
+    class ThreadPool
+    {
+    public:
+        ThreadPool(size_t num_threads);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool &operator=(const ThreadPool&) = delete;
+
+        size_t size() const
+        {
+            return _threads.size();
+        }
+
+        // Call fn(i) for each i in [0, n) and return once all calls are done
+        //
+        // The calling thread takes part, so nested use can't deadlock.
+        // The first exception thrown by fn is rethrown here.
+        void parallel_for(size_t n, const std::function<void(size_t)> &fn);
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::deque<std::function<void()>> _tasks;
+        bool _stopped{false};
+
+        std::vector<std::thread> _threads;
+
+        void run();
+    };
+
+    // Pool shared by the whole process, one thread per core
+    ThreadPool &get_thread_pool();
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "core/media_source.h"
+#include "core/time.h"
+
+namespace core
+{
+    // Downscaled frames of media files, persisted in the cache directory
+    //
+    // Each media file gets its own memory mapped file of fixed size slots,
+    // named after the path and modification time, so editing the original
+    // invalidates its thumbnails. Missing thumbnails are decoded on a
+    // background thread, the ones requested last are generated first.
+    class ThumbnailStore
+    {
+    public:
+        static constexpr int max_width = 160;
+        static constexpr int max_height = 90;
+
+        // Thumbnails are only taken at multiples of this
+        static constexpr auto interval = 1s;
+
+        struct Thumbnail
+        {
+            core::timestamp ts;
+            int width;
+            int height;
+
+            // Tightly packed RGB24, valid for the lifetime of the store
+            const uint8_t *pixels;
+        };
+
+        ThumbnailStore(std::filesystem::path dir);
+        ~ThumbnailStore();
+
+        ThumbnailStore(const ThumbnailStore&) = delete;
+        ThumbnailStore &operator=(const ThumbnailStore&) = delete;
+
+        // Thumbnail at ts rounded down to the interval, queued for
+        // generation if it's not there yet
+        std::optional<Thumbnail> get(const std::string &path, core::timestamp ts);
+
+        std::optional<Thumbnail> get_poster(const std::string &path)
+        {
+            return get(path, 0s);
+        }
+
+    private:
+        class File;
+
+        struct Request
+        {
+            std::string path;
+            core::timestamp ts;
+
+            bool operator<(const Request &rhs) const
+            {
+                return std::tie(path, ts) < std::tie(rhs.path, rhs.ts);
+            }
+        };
+
+        std::filesystem::path _dir;
+
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::unordered_map<std::string, std::unique_ptr<File>> _files;
+        std::deque<Request> _requests;
+
+        // Queued requests and the ones which couldn't be decoded, neither is requested again
+        std::set<Request> _pending;
+        std::set<Request> _failed;
+        bool _stopped{false};
+
+        std::thread _thread;
+
+        // Decoder of the file last generated for, used only by the worker
+        std::string _source_path;
+        std::unique_ptr<core::MediaSource> _source;
+
+        // Without create, files not on disk yet are only remembered as missing
+        File *get_file(const std::string &path, bool create);
+        void run();
+        bool generate(const Request &request);
+    };
+
+    // Store shared by the whole process, kept in the cache directory
+    ThumbnailStore &get_thumbnail_store();
+}
@@ -25,8 +25,12 @@ namespace core
         float scale_x{1.0};
         float scale_y{1.0};
 
+        // Degrees clockwise around the center of the clip
         float rotation{0.0};
 
+        // Multiplies the alpha of the clip, 0 is fully transparent
+        float opacity{1.0};
+
         bool operator<(const ClipTransform &rhs) const
         {
             return rel_position < rhs.rel_position;
@@ -104,6 +108,7 @@ namespace core
             void translate_clip(Clip &clip, float dx, float dy);
             void scale_clip(Clip &clip, float dx, float dy);
             void rotate_clip(Clip &clip, float dr);
+            void fade_clip(Clip &clip, float d_opacity);
 
             bool operator<(const Track &rhs) const
             {
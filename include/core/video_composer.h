@@ -1,10 +1,13 @@
 #pragma once
 
+#include <cmath>
 #include <memory>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "core/composition_cache.h"
 #include "core/media_source.h"
+#include "core/pixel_ops.h"
 #include "core/sync_media_source.h"
 #include "core/time.h"
 #include "core/timeline.h"
@@ -24,15 +27,150 @@ namespace core
         void update_track(core::Timeline::Track &track);
         void remove_track(core::Timeline::TrackID id);
 
+        // Step backwards by one frame in each next_frame call
+        void set_reverse(bool reverse);
+
+        // Let the sources of clips near the position decode ahead of the
+        // composition, on the worker shared by all sources
+        void set_read_ahead(bool enabled);
+
+        // Frames made of opaque, axis-aligned clips only are composed straight
+        // in this format instead of RGBA, others still come out as RGBA
+        void set_native_format(AVPixelFormat format);
+
+        // Keep composed frames around, so positions visited again aren't
+        // composed again unless an edit touched them
+        void set_memoize(bool enabled);
+
+        // Hold on to the layers of the first frame after each seek, so when
+        // only clip transforms changed since, composing that frame again only
+        // redraws the area the changed clips cover now or covered before
+        void set_retain_layers(bool enabled);
+
         std::string get_name() override;
 
         bool seek(core::timestamp position) override;
         bool seek(int64_t byte_offset) override;
 
-        AVFrame* next_frame(AVMediaType frame_type) override;
+        FrameRef next_frame(AVMediaType frame_type) override;
         bool has_stream(AVMediaType frame_type) override;
 
     private:
+        struct Layer;
+
+        // Still image scaled to the size it's shown at, in the output format
+        struct StillFrame
+        {
+            AVPixelFormat format{AV_PIX_FMT_NONE};
+            int width{0};
+            int height{0};
+            bool opaque{false};
+            FrameRef frame;
+
+            bool matches(const Layer &layer, AVPixelFormat out_format) const
+            {
+                return frame && format == out_format && width == layer.width && height == layer.height;
+            }
+        };
+
+        // Clip visible at the position being composed
+        struct Layer
+        {
+            Timeline::Clip *clip;
+            SyncMediaSource *source;
+            ClipTransform xform;
+            float opacity;
+
+            // Placement on the output frame, the size is only known
+            // up front if the file dimensions are
+            int x{0};
+            int y{0};
+            int width{0};
+            int height{0};
+
+            // Scale straight into the output frame, without an own frame
+            bool direct{false};
+
+            // Covered by opaque layers above, or entirely off the frame,
+            // such layers stay in the list but aren't fetched or drawn
+            bool hidden{false};
+
+            // Known to be opaque before decoding, layers below it may be hidden
+            bool occluder{false};
+
+            // Which frame of which clip the layer shows
+            Timeline::ClipID clip_id{0};
+            core::timestamp source_ts{0s};
+
+            // Filled in by prepare_layer, frame stays null if there's nothing to draw
+            FrameRef frame;
+            bool opaque{false};
+
+            // Decoded frame before scaling, only kept when retaining layers
+            FrameRef clip_frame;
+
+            // Scaled copy of a still image clip, only touched by this layer
+            StillFrame *still{nullptr};
+
+            // Rotated layers are warped onto the frame instead of scaled
+            bool rotated() const
+            {
+                return std::fmod(xform.rotation, 360.0f) != 0.0f;
+            }
+
+            // Part of the output frame the layer may draw to
+            Rect bounds() const
+            {
+                if (rotated())
+                    return rotated_bounds(x, y, width, height, xform.rotation);
+
+                return {x, y, x + width, y + height};
+            }
+
+            // Layers of unknown size are assumed to cover everything
+            bool overlaps(const Layer &other) const
+            {
+                if (width <= 0 || height <= 0 || other.width <= 0 || other.height <= 0)
+                    return true;
+
+                const auto a = bounds();
+                const auto b = other.bounds();
+
+                return a.x0 < b.x1 && b.x0 < a.x1 && a.y0 < b.y1 && b.y0 < a.y1;
+            }
+        };
+
+        std::vector<Layer> collect_layers(core::timestamp ts, int out_width, int out_height);
+        bool cull_hidden_layers(std::vector<Layer> &layers, int out_width, int out_height);
+
+        // Identifies what the layers compose into, for looking up memoized frames
+        uint64_t content_key(const std::vector<Layer> &layers, int out_width, int out_height) const;
+
+        // Drop memoized frames over the time ranges of clips which differ
+        // between the two versions of a track, either may be null
+        void invalidate_changes(const Timeline::Track *old_track, const Timeline::Track *new_track);
+
+        // False if a clip turned out not to be opaque where it had to be,
+        // leaving the frame incomplete
+        bool compose(AVFrame *out_frame, core::timestamp ts, std::vector<Layer> &layers);
+        bool can_compose_native(const std::vector<Layer> &layers, int out_width, int out_height) const;
+
+        FrameRef compose_frame(core::timestamp ts, std::vector<Layer> &layers, int width, int height);
+
+        // Redraw the retained frame where layers changed, empty if more
+        // than the transforms of the layers did
+        FrameRef recompose(core::timestamp ts, std::vector<Layer> &layers);
+
+        void prepare_layer(Layer &layer, AVFrame *out_frame);
+        void convert_layer(Layer &layer, AVFrame *clip_frame);
+        void prepare_still(Layer &layer, AVFrame *clip_frame, AVPixelFormat format);
+
+        // Draw the layers which have a frame, only touching the pixels within area
+        void compose_layers(AVFrame *out_frame, const std::vector<Layer> &layers, const Rect &area);
+
+        // Turn read-ahead on for the sources near ts and off for the rest
+        void update_read_ahead(core::timestamp ts);
+
         void add_clip(Timeline::Clip &clip);
         void add_track(Timeline::Track &track);
         void rm_track(Timeline::TrackID track_id);
@@ -40,6 +178,9 @@ namespace core
 
         core::WorkspaceProperties _props;
         core::timestamp _frame_dt;
+        bool _reverse{false};
+        bool _read_ahead{false};
+        AVPixelFormat _native_format{AV_PIX_FMT_NONE};
 
         std::map<Timeline::TrackID, Timeline::Track> _tracks;
 
@@ -54,21 +195,36 @@ namespace core
         // to ensure cache hits.
         std::unordered_map<Timeline::ClipID, SyncMediaSource> _sources;
 
-        // Each track has it's own FrameConverter for the purpose of transforming
-        // its current frame according to the ClipTransformation
+        // Transforms the current frame of each clip according to its ClipTransform
         //
-        // Having one converter per track strikes a balance between number of allocated
-        // temporary frames and frequency of reallocation due to size change
-        std::unordered_map<Timeline::TrackID, ffmpeg::FrameConverter> _frame_converters;
+        // Scaling contexts come from the shared scaler cache, so clips of
+        // different sizes don't rebuild them, and the frames from the shared
+        // frame pool. The layers of a frame are all converted concurrently.
+        ffmpeg::FrameConverter _converter{AV_PIX_FMT_RGBA};
 
         struct Composition
         {
             core::timestamp start_position;
             core::timestamp last_position;
-            std::vector<AVFrame*> frames;
         };
 
         std::unique_ptr<Composition> _composition;
+
+        std::unordered_map<Timeline::ClipID, StillFrame> _stills;
+
+        std::unique_ptr<CompositionCache> _memo;
+
+        // Layers as composed into frame, their clip, source and still
+        // pointers may be stale by now and are never used
+        struct Retained
+        {
+            core::timestamp ts;
+            std::vector<Layer> layers;
+            FrameRef frame;
+        };
+
+        bool _retain{false};
+        std::unique_ptr<Retained> _retained;
     };
 }
 
@@ -5,9 +5,11 @@
 #include "timeline.h"
 
 #include "ffmpeg/io.h"
+#include "ffmpeg/media_source.h"
 #include "core/time.h"
 #include "core/workspace_properties.h"
 #include "core/render_session.h"
+#include "core/proxy_manager.h"
 
 #include "logging.h"
 
@@ -26,6 +28,8 @@ namespace core
         void set_props(const WorkspaceProperties &props)
         {
             _props = props;
+            ffmpeg::set_decode_thread_budget(_props.decode_threads);
+
             properties_changed_event.notify(_props);
         }
 
@@ -38,9 +42,13 @@ namespace core
         {
             LOG_DEBUG(_logger, "Set cursor, ts = {}", position / 1.0s);
 
-            if (position < 0s)
+            if (position <= 0s)
             {
                 _cursor = 0s;
+
+                // If we hit the start while playing backwards, stop
+                if (_preview_active && _preview_reverse)
+                    stop_preview();
             }
             else if (position > _timeline.get_duration())
             {
@@ -112,11 +120,16 @@ namespace core
             _active_clip_id = std::move(id);
         }
 
-        void start_preview()
+        void start_preview(bool reverse = false)
         {
-            LOG_INFO(_logger, "Start preview");
+            LOG_INFO(_logger, "Start preview, reverse = {}", reverse);
+
+            // Frames already composed ahead are for the other direction
+            if (reverse != _preview_reverse)
+                _force_preview_refresh = true;
 
             _preview_active = true;
+            _preview_reverse = reverse;
         }
 
         void stop_preview()
@@ -137,6 +150,11 @@ namespace core
             return _preview_active;
         }
 
+        bool is_preview_reversed() const
+        {
+            return _preview_reverse;
+        }
+
         // Insert clip into currently active track at cursor position
         void add_clip(core::MediaFile media_file);
 
@@ -154,10 +172,13 @@ namespace core
 
         bool _force_preview_refresh{false};
         bool _preview_active{false};
+        bool _preview_reverse{false};
 
         core::timestamp _cursor{0s};
 
         std::unique_ptr<RenderSession> _render_session;
+
+        ProxyManager _proxy_manager;
     };
 }
 
@@ -9,6 +9,12 @@ namespace core
     {
         VideoProperties video;
 
+        // Preview clips through their low resolution proxies once generated
+        bool prefer_proxies{false};
+
+        // Threads shared by all decoders, 0 means one per core
+        int decode_threads{0};
+
         core::timestamp frame_dt() const
         {
             return core::timestamp{core::timestamp(1s).count() / video.fps};
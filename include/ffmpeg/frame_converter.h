@@ -1,26 +1,32 @@
 #pragma once
 
 #include "headers.h"
+#include "scaler_cache.h"
 
 namespace ffmpeg
 {
+    // Converts and scales frames to a target format, with scaling contexts
+    // taken from the shared ScalerCache, so a converter may be used from
+    // several threads at once
     class FrameConverter
     {
     public:
         FrameConverter(AVPixelFormat target_format);
 
-        AVFrame *convert(AVFrame *in_frame, int target_width = 0, int target_height = 0);
+        // New frame of the target format and size, taken from the frame pool
+        AVFrame *convert(AVFrame *in_frame, int target_width, int target_height);
+
+        // Scale straight into the target_width x target_height rect of dst at (x, y),
+        // without going through a temporary frame. Converts to the format of dst,
+        // the rect has to lie within it and be aligned to its chroma subsampling.
+        void convert_into(AVFrame *in_frame, AVFrame *dst, int x, int y, int target_width, int target_height);
 
     private:
-        void alloc_out_frame(int w, int h);
+        ScalerCache::Lease get_scaler(AVFrame *in_frame, int target_width, int target_height, AVPixelFormat target_format) const;
 
         AVPixelFormat _target_format;
-        int _target_width{0};
-        int _target_height{0};
-        AVFrame *_out_frame{nullptr};
 
         int _sws_flags{0};
-        SwsContext *_sws_ctx{nullptr};
     };
 }
 
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+
+#include "headers.h"
+
+namespace ffmpeg
+{
+    // Recycles frame buffers between frames of the same format and size
+    //
+    // Each distinct format and size gets an AVBufferPool, buffers go back to
+    // it once the last reference to a frame using them is dropped. Only the
+    // most recently used pools are kept, so a clip being resized doesn't
+    // leave a pool behind for every size it went through.
+    class FramePool
+    {
+    public:
+        FramePool(size_t max_pools);
+        ~FramePool();
+
+        FramePool(const FramePool&) = delete;
+        FramePool &operator=(const FramePool&) = delete;
+
+        // New frame backed by a pooled buffer, throws if allocation fails
+        AVFrame *get(AVPixelFormat format, int width, int height);
+
+        // Attach a pooled buffer to a frame which has its format and size set,
+        // with room for alloc_width x alloc_height pixels and linesizes aligned
+        // to at least linesize_align
+        bool get_buffer(AVFrame *frame, int alloc_width, int alloc_height, int linesize_align = 0);
+
+    private:
+        struct Pool
+        {
+            AVPixelFormat format;
+            int width;
+            int height;
+            size_t size;
+            AVBufferPool *pool;
+        };
+
+        std::mutex _mutex;
+        size_t _max_pools;
+
+        // Front holds the most recently used pool
+        std::list<Pool> _pools;
+
+        AVBufferRef *get_pooled_buffer(AVPixelFormat format, int width, int height, size_t size);
+    };
+
+    // Pool shared by the decoders, converters and the composer
+    FramePool &get_frame_pool();
+
+    // get_buffer2 callback for decoders, taking video frames from get_frame_pool()
+    int get_pooled_buffer2(AVCodecContext *codec_ctx, AVFrame *frame, int flags);
+}
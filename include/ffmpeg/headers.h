@@ -8,5 +8,6 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
 #include <libavutil/error.h>
+#include <libavutil/pixdesc.h>
 }
 
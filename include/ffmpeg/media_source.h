@@ -8,5 +8,12 @@
 namespace ffmpeg
 {
     std::unique_ptr<core::MediaSource> open_media_source(const core::MediaFile &file);
+
+    // Threads all open video decoders may use together, 0 means one per core
+    //
+    // Applies to decoders opened from now on, each gets what its resolution
+    // can make use of, as far as the threads not held by open decoders go.
+    // A decoder always gets at least one, closing it gives its threads back.
+    void set_decode_thread_budget(int threads);
 }
 
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "core/media_file.h"
+
+namespace ffmpeg
+{
+    // Receives the fraction of the file done so far, returning false cancels
+    using ProxyProgressCallback = std::function<bool(float)>;
+
+    // Transcode the video of file into an MJPEG Matroska file at out_path,
+    // downscaled to the given height
+    //
+    // Frame timestamps are kept, rounded up to the 1ms precision of Matroska.
+    // Returns false if cancelled, throws on failure.
+    bool transcode_proxy(const core::MediaFile &file, const std::string &out_path, int height, const ProxyProgressCallback &progress);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "headers.h"
+
+namespace ffmpeg
+{
+    // Scaling contexts shared by every FrameConverter
+    //
+    // Setting up a context builds its filters, which is costly enough to show
+    // when a track alternates between clips of different sizes or formats.
+    // Idle contexts are kept per conversion, so any thread needing the same
+    // one again gets it ready made. A context is only used by one thread at
+    // a time, concurrent users of the same conversion get one each.
+    class ScalerCache
+    {
+    public:
+        struct Key
+        {
+            int src_width, src_height;
+            AVPixelFormat src_format;
+            int dst_width, dst_height;
+            AVPixelFormat dst_format;
+            int flags;
+
+            bool operator==(const Key &rhs) const
+            {
+                return src_width == rhs.src_width && src_height == rhs.src_height && src_format == rhs.src_format
+                    && dst_width == rhs.dst_width && dst_height == rhs.dst_height && dst_format == rhs.dst_format
+                    && flags == rhs.flags;
+            }
+        };
+
+        // Context checked out of the cache, it goes back once the lease is dropped
+        class Lease
+        {
+        public:
+            Lease(ScalerCache &cache, const Key &key, SwsContext *ctx):
+                _cache(&cache), _key(key), _ctx(ctx)
+            {
+            }
+
+            ~Lease()
+            {
+                if (_ctx)
+                    _cache->release(_key, _ctx);
+            }
+
+            Lease(Lease &&other) noexcept:
+                _cache(other._cache), _key(other._key), _ctx(std::exchange(other._ctx, nullptr))
+            {
+            }
+
+            Lease(const Lease&) = delete;
+            Lease &operator=(const Lease&) = delete;
+            Lease &operator=(Lease&&) = delete;
+
+            SwsContext *get() const
+            {
+                return _ctx;
+            }
+
+        private:
+            ScalerCache *_cache;
+            Key _key;
+            SwsContext *_ctx;
+        };
+
+        ScalerCache(size_t max_idle);
+        ~ScalerCache();
+
+        ScalerCache(const ScalerCache&) = delete;
+        ScalerCache &operator=(const ScalerCache&) = delete;
+
+        // Idle context for the conversion, or a new one, throws if it can't be set up
+        Lease acquire(const Key &key);
+
+    private:
+        struct Entry
+        {
+            Key key;
+            std::vector<SwsContext*> idle;
+        };
+
+        std::mutex _mutex;
+        size_t _max_idle;
+        size_t _num_idle{0};
+
+        // Front holds the most recently used conversion
+        std::list<Entry> _entries;
+
+        void release(const Key &key, SwsContext *ctx);
+        void evict();
+    };
+
+    ScalerCache &get_scaler_cache();
+}
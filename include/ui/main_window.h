@@ -18,6 +18,7 @@
 #include "ui/import_widget.h"
 #include "ui/workspace_properties_widget.h"
 #include "ui/render_widget.h"
+#include "ui/thumbnail_textures.h"
 
 namespace ui
 {
@@ -49,6 +50,7 @@ namespace ui
         core::Event<core::timestamp> _buffer_swapped_event;
 
         ui::TimelineWidget::Properties _timeline_props;
+        ui::ThumbnailTextures _thumbnail_textures;
 
         ui::TimelineWidget _timeline_widget;
         ui::ImportWidget _import_widget;
@@ -28,14 +28,20 @@ namespace ui
         PreviewWorker();
         virtual ~PreviewWorker();
 
-        AVFrame *last_frame{nullptr};
+        core::FrameRef last_frame;
         uint64_t seek_id{0};
         std::optional<core::timestamp> last_frame_display_time;
 
-        using SeekRequest = std::pair<uint64_t, core::timestamp>;
+        struct SeekRequest
+        {
+            uint64_t seek_id;
+            core::timestamp position;
+            bool reverse{false};
+        };
+
         msd::channel<SeekRequest> in_seek;
         
-        using PreviewFrame = std::pair<uint64_t, AVFrame*>;
+        using PreviewFrame = std::pair<uint64_t, core::FrameRef>;
         msd::channel<PreviewFrame> out_frames{1};
 
         struct TrackRemoved { core::Timeline::TrackID id; };
@@ -75,7 +81,10 @@ namespace ui
 
     private:
         std::unique_ptr<core::RenderSession> &_render_session;
-        msd::channel<AVFrame*> _ready_frames;
+        msd::channel<core::FrameRef> _ready_frames;
+
+        // Rendered frames may come out composed in YUV
+        ffmpeg::FrameConverter _display_converter{AV_PIX_FMT_RGBA};
 
         void run() override;
     };
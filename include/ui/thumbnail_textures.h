@@ -0,0 +1,34 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "imgui/imgui.h"
+
+#include "core/thumbnail_store.h"
+#include "core/time.h"
+
+namespace ui
+{
+    // GL textures of the thumbnails in the ThumbnailStore, uploaded on first use
+    //
+    // Textures live as long as the GL context, thumbnails are small
+    // and never change once stored.
+    class ThumbnailTextures
+    {
+    public:
+        // Draw the thumbnail of path at ts fitted into the given rect,
+        // returns false if it's not available yet
+        bool draw(ImDrawList *draw_list, const std::string &path, core::timestamp ts, ImVec2 min, ImVec2 max);
+
+        // Same as draw, as an item in the current window
+        bool image(const std::string &path, core::timestamp ts, ImVec2 size);
+
+    private:
+        std::unordered_map<const uint8_t*, GLuint> _textures;
+
+        ImTextureID get_texture(const core::ThumbnailStore::Thumbnail &thumbnail);
+    };
+}
@@ -27,7 +27,7 @@ namespace core
 
     void Application::run()
     {
-        core::WorkspaceProperties workspace_props{1920, 1080, 30};
+        core::WorkspaceProperties workspace_props{{1920, 1080, 30}, true};
         _workspace = std::make_unique<core::Workspace>(workspace_props);
 
         create_main_window();
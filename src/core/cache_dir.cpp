@@ -0,0 +1,34 @@
+#include "core/cache_dir.h"
+
+#include <cstdlib>
+
+namespace core
+{
+    namespace fs = std::filesystem;
+
+    static fs::path find_cache_dir()
+    {
+        if (const char *val = std::getenv("VED_CACHE_DIR"))
+            return val;
+
+        if (const char *val = std::getenv("XDG_CACHE_HOME"))
+            return fs::path{val} / "ved";
+
+        if (const char *val = std::getenv("HOME"))
+            return fs::path{val} / ".cache" / "ved";
+
+        return fs::temp_directory_path() / "ved";
+    }
+
+    fs::path get_cache_dir()
+    {
+        static const fs::path path = [] {
+            auto path = find_cache_dir();
+            fs::create_directories(path);
+
+            return path;
+        }();
+
+        return path;
+    }
+}
@@ -0,0 +1,118 @@
+#include "core/composition_cache.h"
+#include "logging.h"
+
+#include <cstdlib>
+
+static auto logger = logging::get_logger("CompositionCache");
+
+namespace core
+{
+    static constexpr size_t default_budget_mb = 256;
+
+    CompositionCache::CompositionCache(size_t budget):
+        _budget(budget)
+    {
+        LOG_DEBUG(logger, "Creating CompositionCache, budget = {}MB", _budget >> 20);
+    }
+
+    FrameRef CompositionCache::get(core::timestamp ts, uint64_t key)
+    {
+        const auto it = _frames.find(ts.count());
+
+        if (it == _frames.end() || it->second->key != key)
+        {
+            ++_stats.misses;
+            return {};
+        }
+
+        ++_stats.hits;
+
+        // Mark as most recently used
+        _lru.splice(_lru.begin(), _lru, it->second);
+
+        return it->second->frame.share();
+    }
+
+    void CompositionCache::put(core::timestamp ts, uint64_t key, const FrameRef &frame)
+    {
+        // Composed from something else before, that frame can't be asked for again
+        if (const auto it = _frames.find(ts.count()); it != _frames.end())
+            erase(it->second);
+
+        const auto bytes = frame_size(frame.get());
+
+        _lru.push_front(Entry{ts.count(), key, frame.share(), bytes});
+        _frames.emplace(ts.count(), _lru.begin());
+
+        _stats.bytes += bytes;
+        _stats.frames += 1;
+
+        evict();
+    }
+
+    void CompositionCache::invalidate(core::timestamp begin, core::timestamp end)
+    {
+        auto it = _frames.lower_bound(begin.count());
+        size_t count = 0;
+
+        while (it != _frames.end() && it->first <= end.count())
+        {
+            // erase() removes the map entry as well
+            erase((it++)->second);
+            ++count;
+        }
+
+        _stats.invalidations += count;
+
+        LOG_TRACE_L1(logger, "Invalidate, begin = {}s, end = {}s, frames = {}", begin / 1.0s, end / 1.0s, count);
+    }
+
+    void CompositionCache::clear()
+    {
+        _stats.invalidations += _frames.size();
+        _stats.bytes = 0;
+        _stats.frames = 0;
+
+        _frames.clear();
+        _lru.clear();
+    }
+
+    CompositionCache::Stats CompositionCache::get_stats() const
+    {
+        return _stats;
+    }
+
+    void CompositionCache::erase(LruList::iterator it)
+    {
+        _stats.bytes -= it->bytes;
+        _stats.frames -= 1;
+
+        _frames.erase(it->ts);
+        _lru.erase(it);
+    }
+
+    void CompositionCache::evict()
+    {
+        while (_stats.bytes > _budget && !_lru.empty())
+        {
+            auto it = std::prev(_lru.end());
+
+            LOG_TRACE_L1(logger, "Evict frame, ts = {}s, bytes = {}", core::timestamp{it->ts} / 1.0s, it->bytes);
+
+            ++_stats.evictions;
+            erase(it);
+        }
+    }
+
+    size_t get_composition_cache_budget()
+    {
+        size_t budget_mb = default_budget_mb;
+
+        if (const char *val = std::getenv("VED_COMPOSITION_CACHE_MB"))
+        {
+            budget_mb = std::strtoull(val, nullptr, 10);
+        }
+
+        return budget_mb << 20;
+    }
+}
@@ -0,0 +1,347 @@
+#include "core/decoder_pool.h"
+#include "ffmpeg/media_source.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <cassert>
+
+static auto logger = logging::get_logger("DecoderPool");
+
+namespace core
+{
+    // Used only until the keyframe index of the file is available
+    static constexpr auto seek_ahead_threshold = 3s;
+
+    static constexpr auto keyframe_seek_margin = 1ms;
+
+    static constexpr auto needs_seek = core::timestamp::max();
+
+    DecoderPool::Decoder::Decoder(core::MediaFile file):
+        _file(std::move(file)),
+        _source(ffmpeg::open_media_source(_file))
+    {
+        LOG_DEBUG(logger, "Creating Decoder, path = {}", _file.path);
+    }
+
+    FrameRef DecoderPool::Decoder::frame_at(core::timestamp ts)
+    {
+        if (!_source)
+            return {};
+
+        // The frame decoded last is still the one to show at ts
+        if (_last_fetch_frame && ts > _prev_fetch_ts && ts <= _last_fetch_ts)
+            return _last_fetch_frame.share();
+
+        // Because MediaSource only allows for fetching next_frame
+        // we might want to seek closer to desired timestamp
+        if (const auto seek_ts = find_seek_target(ts))
+        {
+            LOG_DEBUG(logger, "seek, seek_ts = {}s", *seek_ts / 1.0s);
+
+            // Seeking keeps the demuxer and decoders open, only if the container
+            // refuses we start over from the beginning of the file
+            if (!_source->seek(*seek_ts))
+            {
+                LOG_WARNING(logger, "seek failed, reopening {}", _file.path);
+                _source = ffmpeg::open_media_source(_file);
+
+                // Dropped from the pool once the lease ends
+                if (!_source)
+                    return {};
+            }
+
+            _last_fetch_frame.reset();
+        }
+
+        auto [frame, fetch_count] = skip_frames_until(ts);
+
+        if (!frame)
+            return {};
+
+        LOG_TRACE_L1(logger, "decoded frame, fetch_count = {}, ts = {}", fetch_count, core::timestamp{frame->pts} / 1.0s);
+
+        _last_fetch_frame = std::move(frame);
+        _last_fetch_ts = core::timestamp{_last_fetch_frame->pts};
+
+        return _last_fetch_frame.share();
+    }
+
+    bool DecoderPool::Decoder::seek(core::timestamp ts)
+    {
+        _last_fetch_frame.reset();
+
+        if (!_source || !_source->seek(ts))
+            return false;
+
+        // Decoding resumes at a keyframe before ts, anything from ts onwards is ahead of us
+        _last_fetch_ts = ts - core::timestamp{1};
+
+        return true;
+    }
+
+    FrameRef DecoderPool::Decoder::next_frame()
+    {
+        _last_fetch_frame.reset();
+
+        if (!_source)
+            return {};
+
+        auto frame = _source->next_frame(AVMEDIA_TYPE_VIDEO);
+
+        if (frame)
+            _last_fetch_ts = core::timestamp{frame->pts};
+
+        return frame;
+    }
+
+    core::timestamp DecoderPool::Decoder::distance_to(core::timestamp ts) const
+    {
+        if (_last_fetch_frame && ts > _prev_fetch_ts && ts <= _last_fetch_ts)
+            return 0s;
+
+        if (find_seek_target(ts))
+            return needs_seek;
+
+        return ts - _last_fetch_ts;
+    }
+
+    std::optional<core::timestamp> DecoderPool::Decoder::find_seek_target(core::timestamp ts) const
+    {
+        const auto *index = _file.keyframes.get();
+        const auto keyframe = index
+            ? index->keyframe_before(ts)
+            : std::nullopt;
+
+        // While the scan is still running, there may be keyframes past
+        // the last one found which are closer to ts
+        const bool past_index = keyframe.has_value() && !index->is_complete()
+            && keyframe == index->last_keyframe();
+
+        // Without the index all we can do is guess when decoding forward gets too expensive
+        if (!keyframe.has_value() || past_index)
+        {
+            if (ts <= _last_fetch_ts || ts > _last_fetch_ts + seek_ahead_threshold)
+                return ts;
+
+            return {};
+        }
+
+        // Decoding from the keyframe beats decoding through the frames in between
+        if (ts <= _last_fetch_ts || *keyframe > _last_fetch_ts)
+        {
+            // Aim slightly past the keyframe so rounding to the stream time base
+            // doesn't land us on the previous one
+            return std::min(ts, *keyframe + keyframe_seek_margin);
+        }
+
+        return {};
+    }
+
+    std::pair<FrameRef, int> DecoderPool::Decoder::skip_frames_until(core::timestamp ts)
+    {
+        FrameRef frame;
+        core::timestamp frame_ts;
+        size_t fetch_count = 0;
+
+        // Without a skipped frame only ts itself is known to map to the result
+        _prev_fetch_ts = ts - core::timestamp{1};
+
+        // Get next frame which aligns with current timestamp
+        do
+        {
+            if (frame)
+                _prev_fetch_ts = core::timestamp{frame->pts};
+
+            frame = _source->next_frame(AVMEDIA_TYPE_VIDEO);
+            ++fetch_count;
+
+            if (!frame) // Early EOF
+            {
+                return {FrameRef{}, fetch_count};
+            }
+
+            frame_ts = core::timestamp(frame->pts);
+        }
+        while (frame_ts < ts);
+
+        return {std::move(frame), fetch_count};
+    }
+
+    DecoderPool::Lease::Lease(DecoderPool *pool, std::string path, Decoder *decoder):
+        _pool(pool),
+        _path(std::move(path)),
+        _decoder(decoder)
+    {
+    }
+
+    DecoderPool::Lease::Lease(Lease &&other):
+        _pool(other._pool),
+        _path(std::move(other._path)),
+        _decoder(std::exchange(other._decoder, nullptr))
+    {
+    }
+
+    DecoderPool::Lease::~Lease()
+    {
+        release();
+    }
+
+    DecoderPool::Lease &DecoderPool::Lease::operator=(Lease &&other)
+    {
+        if (this != &other)
+        {
+            release();
+
+            _pool = other._pool;
+            _path = std::move(other._path);
+            _decoder = std::exchange(other._decoder, nullptr);
+        }
+
+        return *this;
+    }
+
+    void DecoderPool::Lease::release()
+    {
+        if (_decoder)
+            _pool->release(_path, std::exchange(_decoder, nullptr));
+    }
+
+    DecoderPool::Lease DecoderPool::acquire(const core::MediaFile &file, core::timestamp ts)
+    {
+        std::unique_lock lock{_mutex};
+
+        while (1)
+        {
+            // Looked up on every pass, releases may drop the entry meanwhile
+            auto &entry = _files[file.path];
+
+            Entry *best{nullptr};
+            auto best_distance = needs_seek;
+
+            for (auto &candidate : entry.decoders)
+            {
+                if (candidate.leased)
+                    continue;
+
+                const auto distance = candidate.decoder->distance_to(ts);
+
+                if (!best || distance < best_distance)
+                {
+                    best = &candidate;
+                    best_distance = distance;
+                }
+            }
+
+            const bool can_open = entry.decoders.size() + entry.opening < max_file_decoders;
+
+            // Seeking one decoder away from where another reader left it
+            // would only make that reader seek back, so open another one
+            if (best && (best_distance != needs_seek || !can_open))
+            {
+                best->leased = true;
+
+                return Lease{this, file.path, best->decoder.get()};
+            }
+
+            if (can_open)
+                break;
+
+            _cv.wait(lock);
+        }
+
+        ++_files[file.path].opening;
+        lock.unlock();
+
+        LOG_INFO(logger, "Open decoder, path = {}, ts = {}s", file.path, ts / 1.0s);
+
+        auto decoder = std::make_unique<Decoder>(file);
+
+        lock.lock();
+
+        // Counted as opening, the entry couldn't have been dropped meanwhile
+        auto it = _files.find(file.path);
+        assert(it != _files.end());
+        --it->second.opening;
+
+        if (!decoder->is_open())
+        {
+            erase_if_unused(it);
+            _cv.notify_all();
+            return {};
+        }
+
+        auto *ptr = decoder.get();
+        it->second.decoders.push_back(Entry{std::move(decoder), true});
+
+        return Lease{this, file.path, ptr};
+    }
+
+    void DecoderPool::release(const std::string &path, Decoder *decoder)
+    {
+        std::lock_guard lock{_mutex};
+
+        // Leased decoders keep their entry around
+        auto file_it = _files.find(path);
+        assert(file_it != _files.end());
+
+        auto &entry = file_it->second;
+        auto it = std::find_if(entry.decoders.begin(), entry.decoders.end(), [decoder](const auto &e) {
+            return e.decoder.get() == decoder;
+        });
+
+        if (it == entry.decoders.end())
+            return;
+
+        // Nobody reads the file anymore, or reopening it after a failed seek failed
+        if (entry.users == 0 || !decoder->is_open())
+            entry.decoders.erase(it);
+        else
+            it->leased = false;
+
+        erase_if_unused(file_it);
+        _cv.notify_all();
+    }
+
+    void DecoderPool::add_user(const std::string &path)
+    {
+        std::lock_guard lock{_mutex};
+
+        ++_files[path].users;
+    }
+
+    void DecoderPool::remove_user(const std::string &path)
+    {
+        std::lock_guard lock{_mutex};
+
+        auto it = _files.find(path);
+        assert(it != _files.end() && it->second.users > 0);
+
+        auto &entry = it->second;
+
+        if (--entry.users != 0)
+            return;
+
+        LOG_DEBUG(logger, "Close decoders, path = {}", path);
+
+        entry.decoders.erase(std::remove_if(entry.decoders.begin(), entry.decoders.end(), [](const auto &e) {
+            return !e.leased;
+        }), entry.decoders.end());
+
+        erase_if_unused(it);
+    }
+
+    void DecoderPool::erase_if_unused(decltype(_files)::iterator it)
+    {
+        const auto &entry = it->second;
+
+        if (entry.users == 0 && entry.opening == 0 && entry.decoders.empty())
+            _files.erase(it);
+    }
+
+    DecoderPool &get_decoder_pool()
+    {
+        static DecoderPool pool;
+
+        return pool;
+    }
+}
@@ -0,0 +1,201 @@
+#include "core/frame_cache.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+static auto logger = logging::get_logger("FrameCache");
+
+namespace core
+{
+    static constexpr size_t default_budget_mb = 1024;
+
+    FrameCache::FrameCache(size_t budget):
+        _budget(budget)
+    {
+        LOG_INFO(logger, "Creating FrameCache, budget = {}MB", _budget >> 20);
+    }
+
+    FrameCache::~FrameCache()
+    {
+        for (auto &entry : _lru)
+            av_frame_free(&entry.frame);
+    }
+
+    FrameRef FrameCache::get(const std::string &path, core::timestamp ts)
+    {
+        std::lock_guard lock{_mutex};
+
+        auto &file = _files[path];
+        const auto it = file.frames.find(ts.count());
+
+        if (it == file.frames.end())
+        {
+            ++_stats.misses;
+            ++file.stats.misses;
+
+            return {};
+        }
+
+        ++_stats.hits;
+        ++file.stats.hits;
+
+        // Mark as most recently used
+        _lru.splice(_lru.begin(), _lru, it->second);
+
+        return FrameRef{av_frame_clone(it->second->frame)};
+    }
+
+    bool FrameCache::contains(const std::string &path, core::timestamp ts) const
+    {
+        std::lock_guard lock{_mutex};
+
+        const auto it = _files.find(path);
+
+        return it != _files.end() && it->second.frames.count(ts.count()) != 0;
+    }
+
+    void FrameCache::put(const std::string &path, core::timestamp ts, const FrameRef &frame)
+    {
+        std::lock_guard lock{_mutex};
+
+        auto &file = _files[path];
+
+        if (const auto it = file.frames.find(ts.count()); it != file.frames.end())
+            erase(it->second);
+
+        Entry entry{&file, ts.count(), av_frame_clone(frame.get()), frame_size(frame.get())};
+
+        _lru.push_front(entry);
+        file.frames.emplace(entry.ts, _lru.begin());
+
+        _stats.bytes += entry.bytes;
+        _stats.frames += 1;
+        file.stats.bytes += entry.bytes;
+        file.stats.frames += 1;
+
+        evict();
+    }
+
+    void FrameCache::pin(const std::string &path, core::timestamp center, core::timestamp radius)
+    {
+        std::lock_guard lock{_mutex};
+
+        auto &file = _files[path];
+        file.pin_begin = (center - radius).count();
+        file.pin_end = (center + radius).count();
+    }
+
+    size_t FrameCache::reserve(size_t bytes, size_t min_bytes)
+    {
+        std::lock_guard lock{_mutex};
+
+        const size_t available = (_budget > _stats.reserved)? _budget - _stats.reserved : 0;
+        const size_t granted = std::clamp(bytes, min_bytes, std::max(min_bytes, available));
+
+        _stats.reserved += granted;
+        evict();
+
+        LOG_TRACE_L1(logger, "Reserve, bytes = {}MB, reserved = {}MB", granted >> 20, _stats.reserved >> 20);
+
+        return granted;
+    }
+
+    void FrameCache::release(size_t bytes)
+    {
+        std::lock_guard lock{_mutex};
+
+        _stats.reserved -= bytes;
+    }
+
+    void FrameCache::set_budget(size_t budget)
+    {
+        std::lock_guard lock{_mutex};
+
+        LOG_INFO(logger, "Set budget, budget = {}MB", budget >> 20);
+
+        _budget = budget;
+        evict();
+    }
+
+    size_t FrameCache::get_budget() const
+    {
+        std::lock_guard lock{_mutex};
+
+        return _budget;
+    }
+
+    FrameCache::Stats FrameCache::get_stats() const
+    {
+        std::lock_guard lock{_mutex};
+
+        return _stats;
+    }
+
+    FrameCache::Stats FrameCache::get_file_stats(const std::string &path) const
+    {
+        std::lock_guard lock{_mutex};
+
+        if (const auto it = _files.find(path); it != _files.end())
+            return it->second.stats;
+
+        return {};
+    }
+
+    void FrameCache::erase(LruList::iterator it)
+    {
+        auto *file = it->file;
+
+        _stats.bytes -= it->bytes;
+        _stats.frames -= 1;
+        file->stats.bytes -= it->bytes;
+        file->stats.frames -= 1;
+
+        file->frames.erase(it->ts);
+        av_frame_free(&it->frame);
+
+        _lru.erase(it);
+    }
+
+    void FrameCache::evict()
+    {
+        auto it = _lru.end();
+
+        // Walk from the least recently used entry, leaving pinned frames in place
+        while (_stats.bytes + _stats.reserved > _budget && it != _lru.begin())
+        {
+            --it;
+
+            if (it->file->is_pinned(it->ts))
+                continue;
+
+            LOG_TRACE_L1(logger, "Evict frame, ts = {}s, bytes = {}", core::timestamp{it->ts} / 1.0s, it->bytes);
+
+            ++_stats.evictions;
+            ++it->file->stats.evictions;
+
+            auto next = std::next(it);
+            erase(it);
+            it = next;
+        }
+    }
+
+    static size_t get_budget_from_env()
+    {
+        size_t budget_mb = default_budget_mb;
+
+        if (const char *val = std::getenv("VED_FRAME_CACHE_MB"))
+        {
+            budget_mb = std::strtoull(val, nullptr, 10);
+        }
+
+        return budget_mb << 20;
+    }
+
+    FrameCache &get_frame_cache()
+    {
+        static FrameCache cache{get_budget_from_env()};
+
+        return cache;
+    }
+}
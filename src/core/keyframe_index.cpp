@@ -0,0 +1,79 @@
+#include "core/keyframe_index.h"
+#include "core/task_queue.h"
+
+#include <algorithm>
+
+namespace core
+{
+    // Scans are mostly IO bound, a couple at once keeps the disk busy
+    // without every imported file getting a thread of its own
+    static constexpr size_t num_builder_threads = 2;
+
+    static TaskQueue &get_builder_queue()
+    {
+        // Never destroyed, indexes may still be around during static destruction
+        static auto *queue = new TaskQueue{num_builder_threads};
+
+        return *queue;
+    }
+
+    KeyframeIndex::~KeyframeIndex()
+    {
+        _cancelled = true;
+
+        if (_building)
+            get_builder_queue().remove(this);
+    }
+
+    void KeyframeIndex::build_async(Builder builder)
+    {
+        _building = true;
+        get_builder_queue().push(this, [this, builder = std::move(builder)] {
+            builder(*this);
+            finish();
+        });
+    }
+
+    void KeyframeIndex::add(core::timestamp ts)
+    {
+        std::lock_guard lock{_mutex};
+
+        // Keyframes come in decode order, which is almost always sorted already
+        const auto it = std::upper_bound(_keyframes.begin(), _keyframes.end(), ts);
+        _keyframes.insert(it, ts);
+    }
+
+    void KeyframeIndex::finish()
+    {
+        _complete = true;
+    }
+
+    size_t KeyframeIndex::size() const
+    {
+        std::lock_guard lock{_mutex};
+
+        return _keyframes.size();
+    }
+
+    std::optional<core::timestamp> KeyframeIndex::keyframe_before(core::timestamp ts) const
+    {
+        std::lock_guard lock{_mutex};
+
+        const auto it = std::upper_bound(_keyframes.begin(), _keyframes.end(), ts);
+
+        if (it == _keyframes.begin())
+            return {};
+
+        return *std::prev(it);
+    }
+
+    std::optional<core::timestamp> KeyframeIndex::last_keyframe() const
+    {
+        std::lock_guard lock{_mutex};
+
+        if (_keyframes.empty())
+            return {};
+
+        return _keyframes.back();
+    }
+}
@@ -0,0 +1,712 @@
+#include "core/pixel_ops.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VED_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+static auto logger = logging::get_logger("PixelOps");
+
+namespace core
+{
+    static constexpr int rgba_bpp = 4;
+
+    // Blends a row of width pixels, see blend_over_rgba
+    using BlendRowFn = void (*)(uint8_t *dst, const uint8_t *src, int width, unsigned opacity);
+
+    // x / 255 rounded, exact for x <= 255 * 255
+    static inline unsigned div255(unsigned x)
+    {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+    // out = src * a + dst * (1 - a), with a = src alpha * opacity
+    //
+    // Forcing the source alpha to 255 before multiplying makes the alpha
+    // channel come out as a + dst_a * (1 - a) from the same formula
+    static void blend_row_scalar(uint8_t *dst, const uint8_t *src, int width, unsigned opacity)
+    {
+        for (int i = 0; i < width; i++, dst += 4, src += 4)
+        {
+            const unsigned a = div255(src[3] * opacity);
+            const unsigned inv_a = 255 - a;
+
+            dst[0] = div255(src[0] * a + dst[0] * inv_a);
+            dst[1] = div255(src[1] * a + dst[1] * inv_a);
+            dst[2] = div255(src[2] * a + dst[2] * inv_a);
+            dst[3] = div255(255 * a + dst[3] * inv_a);
+        }
+    }
+
+#ifdef VED_X86_SIMD
+    __attribute__((target("sse4.1")))
+    static inline __m128i div255_sse41(__m128i x)
+    {
+        x = _mm_add_epi16(x, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    }
+
+    __attribute__((target("avx2")))
+    static inline __m256i div255_avx2(__m256i x)
+    {
+        x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    }
+
+    // Two pixels widened to 16 bits per channel
+    __attribute__((target("sse4.1")))
+    static inline __m128i blend_2px_sse41(__m128i s, __m128i d, __m128i opacity, __m128i alpha_lanes)
+    {
+        const __m128i c255 = _mm_set1_epi16(255);
+
+        // Broadcast each pixel's alpha over its four channels
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        a = div255_sse41(_mm_mullo_epi16(a, opacity));
+
+        s = _mm_or_si128(s, alpha_lanes);
+
+        const __m128i sum = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(c255, a)));
+
+        return div255_sse41(sum);
+    }
+
+    __attribute__((target("sse4.1")))
+    static void blend_row_sse41(uint8_t *dst, const uint8_t *src, int width, unsigned opacity)
+    {
+        const __m128i op = _mm_set1_epi16(opacity);
+        const __m128i alpha_lanes = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+        int i = 0;
+
+        for (; i + 4 <= width; i += 4, dst += 16, src += 16)
+        {
+            const __m128i s = _mm_loadu_si128((const __m128i*)src);
+            const __m128i d = _mm_loadu_si128((const __m128i*)dst);
+
+            const __m128i lo = blend_2px_sse41(_mm_cvtepu8_epi16(s), _mm_cvtepu8_epi16(d), op, alpha_lanes);
+            const __m128i hi = blend_2px_sse41(_mm_cvtepu8_epi16(_mm_srli_si128(s, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(d, 8)), op, alpha_lanes);
+
+            _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(lo, hi));
+        }
+
+        blend_row_scalar(dst, src, width - i, opacity);
+    }
+
+    // Four pixels widened to 16 bits per channel, two per 128 bit lane
+    __attribute__((target("avx2")))
+    static inline __m256i blend_4px_avx2(__m256i s, __m256i d, __m256i opacity, __m256i alpha_lanes)
+    {
+        const __m256i c255 = _mm256_set1_epi16(255);
+
+        __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        a = div255_avx2(_mm256_mullo_epi16(a, opacity));
+
+        s = _mm256_or_si256(s, alpha_lanes);
+
+        const __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, _mm256_sub_epi16(c255, a)));
+
+        return div255_avx2(sum);
+    }
+
+    __attribute__((target("avx2")))
+    static void blend_row_avx2(uint8_t *dst, const uint8_t *src, int width, unsigned opacity)
+    {
+        const __m256i op = _mm256_set1_epi16(opacity);
+        const __m256i alpha_lanes = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+
+        int i = 0;
+
+        for (; i + 8 <= width; i += 8, dst += 32, src += 32)
+        {
+            const __m128i s0 = _mm_loadu_si128((const __m128i*)src);
+            const __m128i s1 = _mm_loadu_si128((const __m128i*)(src + 16));
+            const __m128i d0 = _mm_loadu_si128((const __m128i*)dst);
+            const __m128i d1 = _mm_loadu_si128((const __m128i*)(dst + 16));
+
+            const __m256i lo = blend_4px_avx2(_mm256_cvtepu8_epi16(s0), _mm256_cvtepu8_epi16(d0), op, alpha_lanes);
+            const __m256i hi = blend_4px_avx2(_mm256_cvtepu8_epi16(s1), _mm256_cvtepu8_epi16(d1), op, alpha_lanes);
+
+            // Packing works per 128 bit lane, put the pixels back in order
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+
+            _mm256_storeu_si256((__m256i*)dst, packed);
+        }
+
+        blend_row_sse41(dst, src, width - i, opacity);
+    }
+#endif
+
+    static SimdLevel detect_simd_level()
+    {
+#ifdef VED_X86_SIMD
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2"))
+        {
+            LOG_INFO(logger, "Using AVX2 kernels");
+            return SimdLevel::avx2;
+        }
+
+        if (__builtin_cpu_supports("sse4.1"))
+        {
+            LOG_INFO(logger, "Using SSE4.1 kernels");
+            return SimdLevel::sse41;
+        }
+#endif
+
+        LOG_INFO(logger, "Using scalar kernels");
+        return SimdLevel::scalar;
+    }
+
+    SimdLevel get_supported_simd_level()
+    {
+        static const SimdLevel level = detect_simd_level();
+
+        return level;
+    }
+
+    static std::atomic<SimdLevel> simd_level_limit{SimdLevel::avx2};
+
+    void set_simd_level(SimdLevel level)
+    {
+        simd_level_limit = level;
+    }
+
+    static SimdLevel get_simd_level()
+    {
+        return std::min(simd_level_limit.load(std::memory_order_relaxed), get_supported_simd_level());
+    }
+
+    static BlendRowFn select_blend_row(SimdLevel level)
+    {
+#ifdef VED_X86_SIMD
+        if (level >= SimdLevel::avx2)
+            return blend_row_avx2;
+
+        if (level >= SimdLevel::sse41)
+            return blend_row_sse41;
+#endif
+
+        return blend_row_scalar;
+    }
+
+    // Warps count pixels of a row, starting at source coordinates (u, v)
+    using WarpRowFn = void (*)(uint8_t *dst, const AVFrame *src, int count, float u, float v, float du, float dv, float opacity);
+
+    // Texel with its color premultiplied, transparent outside of the frame
+    // so that the edges of the image come out smooth
+    static inline void load_texel(const AVFrame *src, int x, int y, float *out)
+    {
+        if (x < 0 || y < 0 || x >= src->width || y >= src->height)
+        {
+            out[0] = out[1] = out[2] = out[3] = 0.0f;
+            return;
+        }
+
+        const uint8_t *p = src->data[0] + y * src->linesize[0] + x * rgba_bpp;
+        const float a = p[3] * (1.0f / 255.0f);
+
+        out[0] = p[0] * a;
+        out[1] = p[1] * a;
+        out[2] = p[2] * a;
+        out[3] = p[3];
+    }
+
+    static void warp_row_scalar(uint8_t *dst, const AVFrame *src, int count, float u, float v, float du, float dv, float opacity)
+    {
+        for (int i = 0; i < count; i++, dst += rgba_bpp, u += du, v += dv)
+        {
+            const float fu = std::floor(u);
+            const float fv = std::floor(v);
+            const int x = (int)fu;
+            const int y = (int)fv;
+            const float wx = u - fu;
+            const float wy = v - fv;
+
+            float t00[4], t10[4], t01[4], t11[4];
+            load_texel(src, x, y, t00);
+            load_texel(src, x + 1, y, t10);
+            load_texel(src, x, y + 1, t01);
+            load_texel(src, x + 1, y + 1, t11);
+
+            float px[4];
+
+            for (int c = 0; c < 4; c++)
+            {
+                const float top = t00[c] + (t10[c] - t00[c]) * wx;
+                const float bottom = t01[c] + (t11[c] - t01[c]) * wx;
+
+                px[c] = (top + (bottom - top) * wy) * opacity;
+            }
+
+            const float inv_a = 1.0f - px[3] * (1.0f / 255.0f);
+
+            for (int c = 0; c < 4; c++)
+                dst[c] = (uint8_t)std::min(px[c] + dst[c] * inv_a + 0.5f, 255.0f);
+        }
+    }
+
+#ifdef VED_X86_SIMD
+    // The warp kernels below work on several pixels at once, with each
+    // channel in a register of its own. Bilinear taps are gathered as packed
+    // RGBA, texels outside of the source read as transparent black.
+
+    // Channel at shift of each packed RGBA lane, as floats
+    __attribute__((target("sse4.1")))
+    static inline __m128 unpack_channel_sse41(__m128i texels, int shift)
+    {
+        return _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(texels, _mm_cvtsi32_si128(shift)), _mm_set1_epi32(0xff)));
+    }
+
+    // Premultiplied color and alpha of a bilinear sample, summed over its taps
+    struct WarpSample4
+    {
+        __m128 r, g, b, a;
+    };
+
+    __attribute__((target("sse4.1")))
+    static inline void add_tap_sse41(WarpSample4 &sum, __m128i texels, __m128 weight)
+    {
+        const __m128 a = unpack_channel_sse41(texels, 24);
+        const __m128 k = _mm_mul_ps(_mm_mul_ps(weight, a), _mm_set1_ps(1.0f / 255.0f));
+
+        sum.r = _mm_add_ps(sum.r, _mm_mul_ps(k, unpack_channel_sse41(texels, 0)));
+        sum.g = _mm_add_ps(sum.g, _mm_mul_ps(k, unpack_channel_sse41(texels, 8)));
+        sum.b = _mm_add_ps(sum.b, _mm_mul_ps(k, unpack_channel_sse41(texels, 16)));
+        sum.a = _mm_add_ps(sum.a, _mm_mul_ps(weight, a));
+    }
+
+    // c + dst * inv_a for the channel at shift of dst, clamped and moved back to shift
+    __attribute__((target("sse4.1")))
+    static inline __m128i blend_channel_sse41(__m128 c, __m128i dst, __m128 inv_a, int shift)
+    {
+        const __m128 sum = _mm_add_ps(c, _mm_mul_ps(unpack_channel_sse41(dst, shift), inv_a));
+        const __m128i value = _mm_max_epi32(_mm_min_epi32(_mm_cvtps_epi32(sum), _mm_set1_epi32(255)), _mm_setzero_si128());
+
+        return _mm_sll_epi32(value, _mm_cvtsi32_si128(shift));
+    }
+
+    static inline uint32_t load_packed_texel(const AVFrame *src, int x, int y)
+    {
+        if (x < 0 || y < 0 || x >= src->width || y >= src->height)
+            return 0;
+
+        uint32_t packed;
+        std::memcpy(&packed, src->data[0] + y * src->linesize[0] + x * rgba_bpp, sizeof(packed));
+
+        return packed;
+    }
+
+    // Four pixels per iteration, the rest go through the scalar kernel
+    __attribute__((target("sse4.1")))
+    static void warp_row_sse41(uint8_t *dst, const AVFrame *src, int count, float u, float v, float du, float dv, float opacity)
+    {
+        const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 op = _mm_set1_ps(opacity);
+
+        int i = 0;
+
+        for (; i + 4 <= count; i += 4, dst += 4 * rgba_bpp)
+        {
+            // From the row start each time, so errors don't add up along the row
+            const __m128 n = _mm_add_ps(_mm_set1_ps((float)i), lanes);
+            const __m128 pu = _mm_add_ps(_mm_set1_ps(u), _mm_mul_ps(n, _mm_set1_ps(du)));
+            const __m128 pv = _mm_add_ps(_mm_set1_ps(v), _mm_mul_ps(n, _mm_set1_ps(dv)));
+
+            const __m128 fu = _mm_floor_ps(pu);
+            const __m128 fv = _mm_floor_ps(pv);
+            const __m128 wx = _mm_sub_ps(pu, fu);
+            const __m128 wy = _mm_sub_ps(pv, fv);
+
+            alignas(16) int32_t xs[4], ys[4];
+            _mm_store_si128((__m128i*)xs, _mm_cvttps_epi32(fu));
+            _mm_store_si128((__m128i*)ys, _mm_cvttps_epi32(fv));
+
+            alignas(16) uint32_t taps[4][4];
+
+            for (int k = 0; k < 4; k++)
+            {
+                const int x = xs[k];
+                const int y = ys[k];
+
+                // Away from the edges all four texels can be loaded directly
+                if (x >= 0 && y >= 0 && x + 1 < src->width && y + 1 < src->height)
+                {
+                    const uint8_t *p = src->data[0] + y * src->linesize[0] + x * rgba_bpp;
+
+                    std::memcpy(&taps[0][k], p, sizeof(uint32_t));
+                    std::memcpy(&taps[1][k], p + rgba_bpp, sizeof(uint32_t));
+                    std::memcpy(&taps[2][k], p + src->linesize[0], sizeof(uint32_t));
+                    std::memcpy(&taps[3][k], p + src->linesize[0] + rgba_bpp, sizeof(uint32_t));
+                }
+                else
+                {
+                    taps[0][k] = load_packed_texel(src, x, y);
+                    taps[1][k] = load_packed_texel(src, x + 1, y);
+                    taps[2][k] = load_packed_texel(src, x, y + 1);
+                    taps[3][k] = load_packed_texel(src, x + 1, y + 1);
+                }
+            }
+
+            const __m128 inv_wx = _mm_sub_ps(one, wx);
+            const __m128 inv_wy = _mm_sub_ps(one, wy);
+
+            WarpSample4 px{_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+            add_tap_sse41(px, _mm_load_si128((const __m128i*)taps[0]), _mm_mul_ps(inv_wx, inv_wy));
+            add_tap_sse41(px, _mm_load_si128((const __m128i*)taps[1]), _mm_mul_ps(wx, inv_wy));
+            add_tap_sse41(px, _mm_load_si128((const __m128i*)taps[2]), _mm_mul_ps(inv_wx, wy));
+            add_tap_sse41(px, _mm_load_si128((const __m128i*)taps[3]), _mm_mul_ps(wx, wy));
+
+            const __m128 a = _mm_mul_ps(px.a, op);
+            const __m128 inv_a = _mm_sub_ps(one, _mm_mul_ps(a, _mm_set1_ps(1.0f / 255.0f)));
+
+            const __m128i d = _mm_loadu_si128((const __m128i*)dst);
+
+            const __m128i out = _mm_or_si128(
+                _mm_or_si128(blend_channel_sse41(_mm_mul_ps(px.r, op), d, inv_a, 0), blend_channel_sse41(_mm_mul_ps(px.g, op), d, inv_a, 8)),
+                _mm_or_si128(blend_channel_sse41(_mm_mul_ps(px.b, op), d, inv_a, 16), blend_channel_sse41(a, d, inv_a, 24))
+            );
+
+            _mm_storeu_si128((__m128i*)dst, out);
+        }
+
+        warp_row_scalar(dst, src, count - i, u + du * i, v + dv * i, du, dv, opacity);
+    }
+
+    __attribute__((target("avx2")))
+    static inline __m256 unpack_channel_avx2(__m256i texels, int shift)
+    {
+        return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(texels, _mm_cvtsi32_si128(shift)), _mm256_set1_epi32(0xff)));
+    }
+
+    struct WarpSample8
+    {
+        __m256 r, g, b, a;
+    };
+
+    __attribute__((target("avx2")))
+    static inline void add_tap_avx2(WarpSample8 &sum, __m256i texels, __m256 weight)
+    {
+        const __m256 a = unpack_channel_avx2(texels, 24);
+        const __m256 k = _mm256_mul_ps(_mm256_mul_ps(weight, a), _mm256_set1_ps(1.0f / 255.0f));
+
+        sum.r = _mm256_add_ps(sum.r, _mm256_mul_ps(k, unpack_channel_avx2(texels, 0)));
+        sum.g = _mm256_add_ps(sum.g, _mm256_mul_ps(k, unpack_channel_avx2(texels, 8)));
+        sum.b = _mm256_add_ps(sum.b, _mm256_mul_ps(k, unpack_channel_avx2(texels, 16)));
+        sum.a = _mm256_add_ps(sum.a, _mm256_mul_ps(weight, a));
+    }
+
+    __attribute__((target("avx2")))
+    static inline __m256i blend_channel_avx2(__m256 c, __m256i dst, __m256 inv_a, int shift)
+    {
+        const __m256 sum = _mm256_add_ps(c, _mm256_mul_ps(unpack_channel_avx2(dst, shift), inv_a));
+        const __m256i value = _mm256_max_epi32(_mm256_min_epi32(_mm256_cvtps_epi32(sum), _mm256_set1_epi32(255)), _mm256_setzero_si256());
+
+        return _mm256_sll_epi32(value, _mm_cvtsi32_si128(shift));
+    }
+
+    // Texels at (x, y) of each lane, lanes outside of the source aren't read
+    __attribute__((target("avx2")))
+    static inline __m256i gather_texels_avx2(const AVFrame *src, __m256i x, __m256i y)
+    {
+        const __m256i inside = _mm256_andnot_si256(
+            _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), x), _mm256_cmpgt_epi32(_mm256_setzero_si256(), y)),
+                _mm256_or_si256(_mm256_cmpgt_epi32(x, _mm256_set1_epi32(src->width - 1)), _mm256_cmpgt_epi32(y, _mm256_set1_epi32(src->height - 1)))
+            ),
+            _mm256_set1_epi32(-1)
+        );
+
+        const __m256i offsets = _mm256_add_epi32(
+            _mm256_mullo_epi32(y, _mm256_set1_epi32(src->linesize[0])),
+            _mm256_slli_epi32(x, 2)
+        );
+
+        return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)src->data[0], offsets, inside, 1);
+    }
+
+    // Eight pixels per iteration, the rest go through the SSE4.1 kernel
+    __attribute__((target("avx2")))
+    static void warp_row_avx2(uint8_t *dst, const AVFrame *src, int count, float u, float v, float du, float dv, float opacity)
+    {
+        const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 op = _mm256_set1_ps(opacity);
+        const __m256i step = _mm256_set1_epi32(1);
+
+        int i = 0;
+
+        for (; i + 8 <= count; i += 8, dst += 8 * rgba_bpp)
+        {
+            const __m256 n = _mm256_add_ps(_mm256_set1_ps((float)i), lanes);
+            const __m256 pu = _mm256_add_ps(_mm256_set1_ps(u), _mm256_mul_ps(n, _mm256_set1_ps(du)));
+            const __m256 pv = _mm256_add_ps(_mm256_set1_ps(v), _mm256_mul_ps(n, _mm256_set1_ps(dv)));
+
+            const __m256 fu = _mm256_floor_ps(pu);
+            const __m256 fv = _mm256_floor_ps(pv);
+            const __m256 wx = _mm256_sub_ps(pu, fu);
+            const __m256 wy = _mm256_sub_ps(pv, fv);
+            const __m256 inv_wx = _mm256_sub_ps(one, wx);
+            const __m256 inv_wy = _mm256_sub_ps(one, wy);
+
+            const __m256i x = _mm256_cvttps_epi32(fu);
+            const __m256i y = _mm256_cvttps_epi32(fv);
+            const __m256i x1 = _mm256_add_epi32(x, step);
+            const __m256i y1 = _mm256_add_epi32(y, step);
+
+            WarpSample8 px{_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+            add_tap_avx2(px, gather_texels_avx2(src, x, y), _mm256_mul_ps(inv_wx, inv_wy));
+            add_tap_avx2(px, gather_texels_avx2(src, x1, y), _mm256_mul_ps(wx, inv_wy));
+            add_tap_avx2(px, gather_texels_avx2(src, x, y1), _mm256_mul_ps(inv_wx, wy));
+            add_tap_avx2(px, gather_texels_avx2(src, x1, y1), _mm256_mul_ps(wx, wy));
+
+            const __m256 a = _mm256_mul_ps(px.a, op);
+            const __m256 inv_a = _mm256_sub_ps(one, _mm256_mul_ps(a, _mm256_set1_ps(1.0f / 255.0f)));
+
+            const __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+
+            const __m256i out = _mm256_or_si256(
+                _mm256_or_si256(blend_channel_avx2(_mm256_mul_ps(px.r, op), d, inv_a, 0), blend_channel_avx2(_mm256_mul_ps(px.g, op), d, inv_a, 8)),
+                _mm256_or_si256(blend_channel_avx2(_mm256_mul_ps(px.b, op), d, inv_a, 16), blend_channel_avx2(a, d, inv_a, 24))
+            );
+
+            _mm256_storeu_si256((__m256i*)dst, out);
+        }
+
+        warp_row_sse41(dst, src, count - i, u + du * i, v + dv * i, du, dv, opacity);
+    }
+#endif
+
+    static WarpRowFn select_warp_row(SimdLevel level)
+    {
+#ifdef VED_X86_SIMD
+        if (level >= SimdLevel::avx2)
+            return warp_row_avx2;
+
+        if (level >= SimdLevel::sse41)
+            return warp_row_sse41;
+#endif
+
+        return warp_row_scalar;
+    }
+
+    // Narrow [lo, hi) down to the x for which min < a + d * x < max
+    static void clip_linear_range(float a, float d, float min, float max, float &lo, float &hi)
+    {
+        if (d == 0.0f)
+        {
+            if (a <= min || a >= max)
+                hi = lo;
+
+            return;
+        }
+
+        float x0 = (min - a) / d;
+        float x1 = (max - a) / d;
+
+        if (x0 > x1)
+            std::swap(x0, x1);
+
+        lo = std::max(lo, x0);
+        hi = std::min(hi, x1);
+    }
+
+    BlitRect clip_blit_rect(int dst_w, int dst_h, int src_w, int src_h, int x, int y)
+    {
+        const int dst_x0 = std::max(x, 0);
+        const int dst_y0 = std::max(y, 0);
+        const int dst_x1 = std::min(x + src_w, dst_w);
+        const int dst_y1 = std::min(y + src_h, dst_h);
+
+        return {
+            dst_x0 - x, dst_y0 - y,
+            dst_x0, dst_y0,
+            dst_x1 - dst_x0, dst_y1 - dst_y0,
+        };
+    }
+
+    BlitRect clip_blit_area(BlitRect rect, const Rect &area)
+    {
+        const int dst_x0 = std::max(rect.dst_x, area.x0);
+        const int dst_y0 = std::max(rect.dst_y, area.y0);
+        const int dst_x1 = std::min(rect.dst_x + rect.width, area.x1);
+        const int dst_y1 = std::min(rect.dst_y + rect.height, area.y1);
+
+        rect.src_x += dst_x0 - rect.dst_x;
+        rect.src_y += dst_y0 - rect.dst_y;
+        rect.dst_x = dst_x0;
+        rect.dst_y = dst_y0;
+        rect.width = dst_x1 - dst_x0;
+        rect.height = dst_y1 - dst_y0;
+
+        return rect;
+    }
+
+    void clear_rgba(AVFrame *dst, const Rect &area)
+    {
+        const int x0 = std::max(area.x0, 0);
+        const int y0 = std::max(area.y0, 0);
+        const int x1 = std::min(area.x1, dst->width);
+        const int y1 = std::min(area.y1, dst->height);
+
+        if (x1 <= x0 || y1 <= y0)
+            return;
+
+        const auto row_bytes = (size_t)(x1 - x0) * rgba_bpp;
+
+        // Padding between rows is left alone, unless whole contiguous rows are cleared
+        if (x0 == 0 && x1 == dst->width && (size_t)dst->linesize[0] == row_bytes)
+        {
+            std::memset(dst->data[0] + y0 * dst->linesize[0], 0, row_bytes * (y1 - y0));
+            return;
+        }
+
+        for (int i = y0; i < y1; i++)
+            std::memset(dst->data[0] + i * dst->linesize[0] + x0 * rgba_bpp, 0, row_bytes);
+    }
+
+    void blit_rgba(AVFrame *dst, const AVFrame *src, int x, int y)
+    {
+        blit_rgba(dst, src, x, y, Rect{0, 0, dst->width, dst->height});
+    }
+
+    void blit_rgba(AVFrame *dst, const AVFrame *src, int x, int y, const Rect &area)
+    {
+        auto rect = clip_blit_rect(dst->width, dst->height, src->width, src->height, x, y);
+        rect = clip_blit_area(rect, area);
+
+        if (rect.empty())
+            return;
+
+        const auto row_bytes = (size_t)rect.width * rgba_bpp;
+
+        uint8_t *dst_row = dst->data[0] + rect.dst_y * dst->linesize[0] + rect.dst_x * rgba_bpp;
+        const uint8_t *src_row = src->data[0] + rect.src_y * src->linesize[0] + rect.src_x * rgba_bpp;
+
+        // Rows are contiguous, memcpy picks the widest vector copy the CPU has
+        for (int i = 0; i < rect.height; i++)
+        {
+            std::memcpy(dst_row, src_row, row_bytes);
+
+            dst_row += dst->linesize[0];
+            src_row += src->linesize[0];
+        }
+    }
+
+    void blend_over_rgba(AVFrame *dst, const AVFrame *src, int x, int y, float opacity)
+    {
+        blend_over_rgba(dst, src, x, y, opacity, Rect{0, 0, dst->width, dst->height});
+    }
+
+    void blend_over_rgba(AVFrame *dst, const AVFrame *src, int x, int y, float opacity, const Rect &area)
+    {
+        const BlendRowFn blend_row = select_blend_row(get_simd_level());
+
+        auto rect = clip_blit_rect(dst->width, dst->height, src->width, src->height, x, y);
+        rect = clip_blit_area(rect, area);
+
+        if (rect.empty())
+            return;
+
+        const auto opacity_u8 = (unsigned)(std::clamp(opacity, 0.0f, 1.0f) * 255.0f + 0.5f);
+
+        uint8_t *dst_row = dst->data[0] + rect.dst_y * dst->linesize[0] + rect.dst_x * rgba_bpp;
+        const uint8_t *src_row = src->data[0] + rect.src_y * src->linesize[0] + rect.src_x * rgba_bpp;
+
+        for (int i = 0; i < rect.height; i++)
+        {
+            blend_row(dst_row, src_row, rect.width, opacity_u8);
+
+            dst_row += dst->linesize[0];
+            src_row += src->linesize[0];
+        }
+    }
+
+    AffineMap place_rotated(int src_w, int src_h, int x, int y, int width, int height, float degrees)
+    {
+        const float theta = degrees * (float)M_PI / 180.0f;
+        const float cos_t = std::cos(theta);
+        const float sin_t = std::sin(theta);
+
+        // Source texels per destination pixel
+        const float kx = (float)src_w / std::max(width, 1);
+        const float ky = (float)src_h / std::max(height, 1);
+
+        const float cx = x + width * 0.5f;
+        const float cy = y + height * 0.5f;
+
+        // Undo the rotation around the center, then the scaling, for the
+        // center of pixel (0, 0), and texel centers sit at +0.5 as well
+        const float dx = 0.5f - cx;
+        const float dy = 0.5f - cy;
+
+        return {
+            (cos_t * dx + sin_t * dy) * kx + src_w * 0.5f - 0.5f,
+            (-sin_t * dx + cos_t * dy) * ky + src_h * 0.5f - 0.5f,
+            cos_t * kx, -sin_t * ky,
+            sin_t * kx, cos_t * ky,
+        };
+    }
+
+    Rect rotated_bounds(int x, int y, int width, int height, float degrees)
+    {
+        const float theta = degrees * (float)M_PI / 180.0f;
+        const float cos_t = std::abs(std::cos(theta));
+        const float sin_t = std::abs(std::sin(theta));
+
+        const float cx = x + width * 0.5f;
+        const float cy = y + height * 0.5f;
+        const float half_w = (width * cos_t + height * sin_t) * 0.5f;
+        const float half_h = (width * sin_t + height * cos_t) * 0.5f;
+
+        return {
+            (int)std::floor(cx - half_w), (int)std::floor(cy - half_h),
+            (int)std::ceil(cx + half_w), (int)std::ceil(cy + half_h),
+        };
+    }
+
+    void warp_over_rgba(AVFrame *dst, const AVFrame *src, const AffineMap &map, float opacity, const Rect &area)
+    {
+        const WarpRowFn warp_row = select_warp_row(get_simd_level());
+
+        const int rows_begin = std::max(area.y0, 0);
+        const int rows_end = std::min(area.y1, dst->height);
+        const int cols_begin = std::max(area.x0, 0);
+        const int cols_end = std::min(area.x1, dst->width);
+
+        opacity = std::clamp(opacity, 0.0f, 1.0f);
+
+        for (int y = rows_begin; y < rows_end; y++)
+        {
+            const float u = map.u0 + map.du_dy * y;
+            const float v = map.v0 + map.dv_dy * y;
+
+            // Only visit the span of the row where any of the four texels
+            // sampled is inside the source
+            float lo = 0.0f;
+            float hi = (float)dst->width;
+
+            clip_linear_range(u, map.du_dx, -1.0f, (float)src->width, lo, hi);
+            clip_linear_range(v, map.dv_dx, -1.0f, (float)src->height, lo, hi);
+
+            const int x0 = std::max((int)std::ceil(lo), cols_begin);
+            const int x1 = std::min((int)std::floor(hi) + 1, cols_end);
+
+            if (x1 <= x0)
+                continue;
+
+            uint8_t *dst_row = dst->data[0] + y * dst->linesize[0] + x0 * rgba_bpp;
+
+            warp_row(dst_row, src, x1 - x0, u + map.du_dx * x0, v + map.dv_dx * x0, map.du_dx, map.dv_dx, opacity);
+        }
+    }
+}
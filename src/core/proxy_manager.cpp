@@ -0,0 +1,166 @@
+#include "core/proxy_manager.h"
+#include "core/cache_dir.h"
+#include "ffmpeg/io.h"
+#include "ffmpeg/proxy.h"
+#include "logging.h"
+
+#include "fmt/format.h"
+
+#include <functional>
+
+static auto logger = logging::get_logger("ProxyManager");
+
+namespace core
+{
+    namespace fs = std::filesystem;
+
+    ProxyManager::ProxyManager():
+        _dir(get_cache_dir() / "proxies")
+    {
+        LOG_INFO(logger, "Creating ProxyManager, dir = {}", _dir.string());
+
+        fs::create_directories(_dir);
+
+        _thread = std::thread{[this] { run(); }};
+    }
+
+    ProxyManager::~ProxyManager()
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _stopped = true;
+        }
+
+        _cv.notify_all();
+        _thread.join();
+    }
+
+    void ProxyManager::request(core::MediaFile &file)
+    {
+        if (file.type != core::MediaFile::VIDEO || file.height <= proxy_height)
+            return;
+
+        std::shared_ptr<core::Proxy> proxy;
+
+        {
+            std::lock_guard lock{_mutex};
+
+            // Same file imported again, share the proxy
+            if (const auto it = _proxies.find(file.path); it != _proxies.end())
+            {
+                file.proxy = it->second;
+                return;
+            }
+
+            proxy = std::make_shared<core::Proxy>();
+            _proxies.emplace(file.path, proxy);
+        }
+
+        file.proxy = proxy;
+
+        // Opening the file takes a while, others sharing the proxy see
+        // it queued until then
+        const auto out_path = get_proxy_path(file.path);
+
+        if (fs::exists(out_path))
+        {
+            LOG_INFO(logger, "Reusing proxy, path = {}", out_path.string());
+
+            try
+            {
+                proxy->media = ffmpeg::io::open_file(out_path.string());
+                proxy->progress = 1.0f;
+                proxy->status = core::Proxy::READY;
+
+                return;
+            }
+            catch (const std::exception &ex)
+            {
+                LOG_WARNING(logger, "Cannot open proxy, regenerating, what = {}", ex.what());
+            }
+        }
+
+        {
+            std::lock_guard lock{_mutex};
+            _jobs.push_back(Job{file, out_path, proxy});
+        }
+
+        _cv.notify_all();
+    }
+
+    fs::path ProxyManager::get_proxy_path(const std::string &path) const
+    {
+        std::error_code ec;
+        const auto size = fs::file_size(path, ec);
+        const auto mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+
+        const auto key = fmt::format("{}:{}:{}", path, size, mtime);
+        const auto hash = std::hash<std::string>{}(key);
+
+        return _dir / fmt::format("{:016x}.mkv", hash);
+    }
+
+    void ProxyManager::run()
+    {
+        std::unique_lock lock{_mutex};
+
+        while (1)
+        {
+            _cv.wait(lock, [this] { return _stopped || !_jobs.empty(); });
+
+            if (_stopped)
+                break;
+
+            auto job = std::move(_jobs.front());
+            _jobs.pop_front();
+
+            lock.unlock();
+            generate(job);
+            lock.lock();
+        }
+    }
+
+    void ProxyManager::generate(Job &job)
+    {
+        LOG_INFO(logger, "Generate proxy, path = {}", job.file.path);
+
+        auto &proxy = *job.proxy;
+        proxy.status = core::Proxy::GENERATING;
+
+        // Written under a temporary name, so an interrupted run never leaves
+        // a truncated proxy which would be picked up next time
+        auto tmp_path = job.out_path;
+        tmp_path += ".part";
+
+        try
+        {
+            const bool done = ffmpeg::transcode_proxy(job.file, tmp_path.string(), proxy_height, [this, &proxy](float progress) {
+                proxy.progress = progress;
+                return !_stopped;
+            });
+
+            if (!done)
+            {
+                fs::remove(tmp_path);
+                proxy.status = core::Proxy::FAILED;
+
+                return;
+            }
+
+            fs::rename(tmp_path, job.out_path);
+
+            proxy.media = ffmpeg::io::open_file(job.out_path.string());
+            proxy.progress = 1.0f;
+            proxy.status = core::Proxy::READY;
+        }
+        catch (const std::exception &ex)
+        {
+            LOG_ERROR(logger, "Proxy generation failed, path = {}, what = {}", job.file.path, ex.what());
+
+            std::error_code ec;
+            fs::remove(tmp_path, ec);
+
+            proxy.status = core::Proxy::FAILED;
+        }
+    }
+}
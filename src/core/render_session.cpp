@@ -1,6 +1,7 @@
 #include "core/render_session.h"
 
 #include "core/application.h"
+#include "ffmpeg/frame_converter.h"
 #include "ffmpeg/media_sink.h"
 #include "logging.h"
 
@@ -8,6 +9,9 @@ namespace core
 {
     static auto logger = logging::get_logger("RenderSession");
 
+    // Frames each stage may get ahead of the next one
+    static constexpr size_t queue_depth = 4;
+
     static WorkspaceProperties props_from_render_settings(const RenderSettings &settings)
     {
         return {
@@ -18,7 +22,9 @@ namespace core
     }
 
     RenderSession::RenderSession(core::Timeline &timeline, RenderSettings settings):
-        _composer(timeline, props_from_render_settings(settings))
+        _composer(timeline, props_from_render_settings(settings)),
+        _composed_frames(queue_depth),
+        _encode_jobs(queue_depth)
     {
         _sink = ffmpeg::open_media_sink(settings.output_path, {settings.video, {}});
 
@@ -28,34 +34,93 @@ namespace core
             throw std::exception();
         }
 
-        _thread = std::thread{[this, &timeline] {
-            while (1)
-            {
-                AVFrame *frame = _composer.next_frame(AVMEDIA_TYPE_VIDEO);
-
-                if (frame == nullptr)
-                {
-                    LOG_DEBUG(logger, "No more frames available");
-                    break;
-                }
-
-                if (core::timestamp{frame->pts} >= timeline.get_duration())
-                {
-                    LOG_DEBUG(logger, "Reached the end of timeline");
-                    break;
-                }
-
-                _sink->write_frame(AVMEDIA_TYPE_VIDEO, frame);
-                frame_ready_event.notify(frame);
-            }
+        // Compose plain cuts in the encoder's format, skipping the RGBA round trip
+        _composer.set_native_format(_sink->get_video_format());
 
-            finished_event.notify();
-        }};
+        // Overlap decoding with composing and encoding
+        _composer.set_read_ahead(true);
+
+        _encode_thread = std::thread{[this] { encode(); }};
+        _convert_thread = std::thread{[this] { convert(); }};
+        _compose_thread = std::thread{[this, duration = timeline.get_duration()] { compose(duration); }};
     }
 
     RenderSession::~RenderSession()
     {
+        // Each stage finishes once the one before it has, so the frames
+        // already queued still make it into the file
+        _stopped = true;
+
+        _compose_thread.join();
+        _convert_thread.join();
+        _encode_thread.join();
+
         _sink.reset();
-        _thread.join();
+    }
+
+    void RenderSession::compose(core::timestamp duration)
+    {
+        while (!_stopped)
+        {
+            auto frame = _composer.next_frame(AVMEDIA_TYPE_VIDEO);
+
+            if (!frame)
+            {
+                LOG_DEBUG(logger, "No more frames available");
+                break;
+            }
+
+            if (core::timestamp{frame->pts} >= duration)
+            {
+                LOG_DEBUG(logger, "Reached the end of timeline");
+                break;
+            }
+
+            // Blocks while the converter is queue_depth frames behind
+            _composed_frames << std::move(frame);
+        }
+
+        _composed_frames.close();
+    }
+
+    void RenderSession::convert()
+    {
+        ffmpeg::FrameConverter converter{_sink->get_video_format()};
+
+        for (auto &&frame : _composed_frames)
+        {
+            EncodeJob job{std::move(frame), {}};
+            const auto format = _sink->get_video_format();
+
+            // Frames composed in the encoder's format go through as they are,
+            // the sink takes care of anything else itself
+            if (format != AV_PIX_FMT_NONE && job.composed->format != format)
+            {
+                job.converted = FrameRef{converter.convert(job.composed.get(), job.composed->width, job.composed->height)};
+                av_frame_copy_props(job.converted.get(), job.composed.get());
+            }
+            else
+            {
+                job.converted = job.composed.share();
+            }
+
+            _encode_jobs << std::move(job);
+        }
+
+        _encode_jobs.close();
+    }
+
+    void RenderSession::encode()
+    {
+        for (auto &&job : _encode_jobs)
+        {
+            _sink->write_frame(AVMEDIA_TYPE_VIDEO, job.converted);
+
+            // Passed on as composed, possibly still in YUV, the preview
+            // converts only the frames it gets around to showing
+            frame_ready_event.notify(job.composed);
+        }
+
+        finished_event.notify();
     }
 }
@@ -0,0 +1,237 @@
+#include "core/reverse_decoder.h"
+#include "core/decoder_pool.h"
+#include "core/frame_cache.h"
+#include "logging.h"
+
+#include <algorithm>
+
+static auto logger = logging::get_logger("ReverseDecoder");
+
+namespace core
+{
+    // How far back to start a segment when the keyframe index can't tell us
+    static constexpr auto fallback_segment_span = 1s;
+
+    static constexpr auto keyframe_seek_margin = 1ms;
+
+    // Long GOPs are split into multiple segments, a single segment takes
+    // at most this share of the frame cache budget, which it's charged to
+    static constexpr size_t segment_budget_share = 8;
+    static constexpr size_t min_segment_frames = 4;
+
+    ReverseDecoder::Segment::~Segment()
+    {
+        if (reserved)
+            get_frame_cache().release(reserved);
+    }
+
+    bool ReverseDecoder::Segment::covers(core::timestamp ts) const
+    {
+        if (frames.empty())
+            return false;
+
+        return ts >= cover_begin && ts <= core::timestamp{frames.back()->pts};
+    }
+
+    const FrameRef *ReverseDecoder::Segment::find(core::timestamp ts) const
+    {
+        const auto it = std::lower_bound(frames.begin(), frames.end(), ts, [](const FrameRef &frame, core::timestamp ts) {
+            return core::timestamp{frame->pts} < ts;
+        });
+
+        return (it != frames.end())? &*it : nullptr;
+    }
+
+    ReverseDecoder::ReverseDecoder(core::MediaFile file):
+        _file(std::move(file))
+    {
+        LOG_DEBUG(logger, "Creating ReverseDecoder, path = {}", _file.path);
+
+        get_decoder_pool().add_user(_file.path);
+
+        _thread = std::thread{[this] { run(); }};
+    }
+
+    ReverseDecoder::~ReverseDecoder()
+    {
+        {
+            std::lock_guard lock{_mutex};
+
+            _stopped = true;
+            ++_generation;
+        }
+
+        _cv.notify_all();
+        _thread.join();
+
+        get_decoder_pool().remove_user(_file.path);
+    }
+
+    FrameRef ReverseDecoder::frame_at(core::timestamp ts)
+    {
+        std::unique_lock lock{_mutex};
+
+        if (_current && _current->covers(ts))
+            return serve(ts);
+
+        // Most likely the segment which is being prefetched, so wait for it
+        // instead of starting over
+        _cv.wait(lock, [this] { return _done_generation == _generation; });
+
+        if (_prefetched && _prefetched->covers(ts))
+        {
+            LOG_DEBUG(logger, "Switch to prefetched segment, ts = {}s", ts / 1.0s);
+
+            _current = std::move(_prefetched);
+            schedule_prefetch();
+
+            return serve(ts);
+        }
+
+        // Jumped past what's buffered, decode a new segment ending at ts
+        LOG_DEBUG(logger, "Decode segment, ts = {}s", ts / 1.0s);
+
+        _current.reset();
+        _prefetched.reset();
+        submit_job(ts);
+
+        const uint64_t generation = _generation;
+        _cv.wait(lock, [this, generation] { return _done_generation == generation; });
+
+        _current = std::move(_prefetched);
+
+        if (!_current || !_current->covers(ts))
+            return {};
+
+        schedule_prefetch();
+
+        return serve(ts);
+    }
+
+    void ReverseDecoder::run()
+    {
+        std::unique_lock lock{_mutex};
+
+        while (1)
+        {
+            _cv.wait(lock, [this] { return _stopped || _job.has_value(); });
+
+            if (_stopped)
+                break;
+
+            const auto job = *_job;
+            _job.reset();
+
+            lock.unlock();
+            auto segment = decode_segment(job);
+            lock.lock();
+
+            // Discard if a newer job came in meanwhile
+            if (job.generation == _generation)
+            {
+                _prefetched = std::move(segment);
+                _done_generation = job.generation;
+                _cv.notify_all();
+            }
+        }
+    }
+
+    void ReverseDecoder::submit_job(core::timestamp end)
+    {
+        _job = Job{++_generation, end};
+        _cv.notify_all();
+    }
+
+    void ReverseDecoder::schedule_prefetch()
+    {
+        if (_current->cover_begin <= 0s)
+            return;
+
+        // Decode up to the first frame of the current segment, so there is no
+        // gap between the two
+        submit_job(_current->cover_begin);
+    }
+
+    FrameRef ReverseDecoder::serve(core::timestamp ts)
+    {
+        const auto *frame = _current->find(ts);
+
+        // Frames past the served one won't be needed while going backwards
+        while (&_current->frames.back() != frame)
+            _current->frames.pop_back();
+
+        return frame->share();
+    }
+
+    ReverseDecoder::SegmentPtr ReverseDecoder::decode_segment(const Job &job)
+    {
+        auto begin = std::max(job.end - fallback_segment_span, core::timestamp{0s});
+        auto seek_ts = begin;
+
+        // Start at the keyframe strictly before end, starting at end itself
+        // would only ever produce a single frame when called from prefetch
+        if (_file.keyframes)
+        {
+            if (const auto keyframe = _file.keyframes->keyframe_before(job.end - core::timestamp{1}))
+            {
+                begin = *keyframe;
+                seek_ts = std::min(job.end, *keyframe + keyframe_seek_margin);
+            }
+        }
+
+        LOG_DEBUG(logger, "Decode segment, begin = {}s, end = {}s", begin / 1.0s, job.end / 1.0s);
+
+        auto decoder = get_decoder_pool().acquire(_file, seek_ts);
+
+        if (!decoder)
+            return nullptr;
+
+        if (!decoder->seek(seek_ts))
+        {
+            LOG_WARNING(logger, "Seek failed, ts = {}s", seek_ts / 1.0s);
+            return nullptr;
+        }
+
+        auto segment = std::make_unique<Segment>();
+        segment->cover_begin = begin;
+
+        size_t max_frames{0};
+
+        while (job.generation == _generation)
+        {
+            auto frame = decoder->next_frame();
+
+            if (!frame) // EOF
+                break;
+
+            const core::timestamp frame_ts{frame->pts};
+
+            if (frame_ts < begin)
+                continue;
+
+            if (max_frames == 0)
+            {
+                auto &cache = get_frame_cache();
+                const size_t bytes = std::max(frame_size(frame.get()), size_t{1});
+
+                // Other segments may hold most of the budget already
+                segment->reserved = cache.reserve(cache.get_budget() / segment_budget_share, min_segment_frames * bytes);
+                max_frames = std::max(min_segment_frames, segment->reserved / bytes);
+            }
+
+            segment->frames.push_back(std::move(frame));
+
+            // Ring buffer, forget the oldest frames once full
+            if (segment->frames.size() > max_frames)
+            {
+                segment->cover_begin = core::timestamp{segment->frames.front()->pts + 1};
+                segment->frames.pop_front();
+            }
+
+            if (frame_ts >= job.end)
+                break;
+        }
+
+        return segment;
+    }
+}
@@ -1,32 +1,105 @@
 #include "core/sync_media_source.h"
-#include "ffmpeg/media_source.h"
+#include "core/decoder_pool.h"
+#include "core/frame_cache.h"
+#include "core/task_queue.h"
 #include "logging.h"
 
 #include "charls/charls.h"
 
-#include <unordered_map>
+#include <algorithm>
+#include <thread>
 
 static auto logger = logging::get_logger("SyncMediaSource");
 
-using FrameCache = std::unordered_map<core::timestamp::rep, AVFrame*>;
-static std::unordered_map<std::string, FrameCache> file_caches;
-
 namespace core
 {
-    static constexpr auto seek_ahead_threshold = 3s;
+    // Backward requests closer than this to the previous one are treated as reverse playback
+    static constexpr auto reverse_step_threshold = 1s;
+
+    // Frames this close to the last request stay cached regardless of budget
+    static constexpr auto cache_pin_radius = 250ms;
+
+    // Read-ahead depth is counted in requests, it doubles on every miss
+    // during playback and shrinks slowly while the worker keeps up
+    static constexpr size_t min_read_ahead_depth = 2;
+    static constexpr size_t max_read_ahead_depth = 32;
+
+    // Larger forward steps are seeks rather than playback
+    static constexpr auto max_read_ahead_step = 250ms;
+
+    // Decoders run threaded already, a few workers are enough for all sources
+    static constexpr unsigned max_read_ahead_threads = 4;
+
+    static TaskQueue &get_read_ahead_queue()
+    {
+        // Never destroyed, like the keyframe index builders
+        static auto *queue = new TaskQueue{std::clamp(std::thread::hardware_concurrency() / 4, 1u, max_read_ahead_threads)};
 
-    SyncMediaSource::SyncMediaSource(core::MediaFile file):
+        return *queue;
+    }
+
+    SyncMediaSource::SyncMediaSource(core::MediaFile file, bool prefer_proxy):
         _file(std::move(file)),
-        _raw_source(ffmpeg::open_media_source(_file))
+        _proxy(prefer_proxy? _file.proxy : nullptr),
+        _read_ahead_depth(min_read_ahead_depth)
     {
-        if (file_caches.find(_file.path) == file_caches.end())
-            file_caches[_file.path] = {};
+        if (_proxy && _proxy->is_ready())
+        {
+            LOG_DEBUG(logger, "Using proxy, path = {}", _file.path);
+
+            _file = _proxy->media;
+            _using_proxy = true;
+        }
+
+        get_decoder_pool().add_user(_file.path);
     }
 
-    AVFrame *SyncMediaSource::frame_at(core::timestamp req_ts)
+    SyncMediaSource::~SyncMediaSource()
+    {
+        set_read_ahead(false);
+
+        // The reverse decoder leases from the pool too
+        _reverse_decoder.reset();
+        get_decoder_pool().remove_user(_file.path);
+    }
+
+    void SyncMediaSource::set_read_ahead(bool enabled)
+    {
+        // Still images only ever have one frame
+        if (_file.type == core::MediaFile::STATIC_IMAGE)
+            return;
+
+        {
+            std::lock_guard lock{_read_ahead_mutex};
+
+            if (enabled == _read_ahead_enabled)
+                return;
+
+            _read_ahead_enabled = enabled;
+
+            if (enabled)
+            {
+                queue_read_ahead();
+                return;
+            }
+
+            ++_read_ahead_generation;
+        }
+
+        // Nothing requeues once disabled, so the step is gone for good after this
+        get_read_ahead_queue().remove(this);
+
+        std::lock_guard lock{_read_ahead_mutex};
+        _read_ahead_queued = false;
+    }
+
+    FrameRef SyncMediaSource::frame_at(core::timestamp req_ts)
     {
         core::timestamp ts = req_ts;
 
+        if (_proxy && !_using_proxy && _proxy->is_ready())
+            switch_to_proxy();
+
         LOG_DEBUG(logger, "frame_at, ts = {}s, lreq = {}s, lret = {}s", req_ts / 1.0s, _last_req_ts / 1.0s, _last_ret_ts / 1.0s);
 
         // Single image handling
@@ -45,67 +118,221 @@ namespace core
             ts = _last_req_ts;
         }
 
-        auto &cache = file_caches.at(_file.path);
+        auto &cache = get_frame_cache();
+        cache.pin(_file.path, ts, cache_pin_radius);
+
+        auto cached_frame = cache.get(_file.path, ts);
+        update_read_ahead(ts, (bool)cached_frame);
 
         // Return frame from cache early if present
-        if (auto it = cache.find(ts.count()); it != cache.end())
+        if (cached_frame)
         {
-            const auto *frame = it->second;
-
-            LOG_DEBUG(logger, "return cached frame, ts = {}s", core::timestamp{frame->pts} / 1.0s);
+            LOG_DEBUG(logger, "return cached frame, ts = {}s", core::timestamp{cached_frame->pts} / 1.0s);
             _last_req_ts = req_ts;
-            _last_ret_ts = core::timestamp{frame->pts};
+            _last_ret_ts = core::timestamp{cached_frame->pts};
+
+            return cached_frame;
+        }
+
+        // Stepping or playing backwards, serve from a GOP decoded ahead of time
+        if (is_reverse_step(req_ts))
+        {
+            if (!_reverse_decoder)
+                _reverse_decoder = std::make_unique<ReverseDecoder>(_file);
+
+            if (auto frame = _reverse_decoder->frame_at(ts))
+            {
+                LOG_DEBUG(logger, "return reverse frame, ts = {}s", core::timestamp{frame->pts} / 1.0s);
+                _last_req_ts = req_ts;
+                _last_ret_ts = core::timestamp{frame->pts};
+
+                cache.put(_file.path, ts, frame);
 
-            return av_frame_clone(frame);
+                return frame;
+            }
         }
+        else if (req_ts > _last_req_ts)
+        {
+            // Going forward again, free the buffered GOPs
+            _reverse_decoder.reset();
+        }
+
+        FrameRef frame;
 
-        // Because MediaSource only allows for fetching next_frame
-        // we might want to create a new one a seek closer to desired timestamp
-        if (ts <= _last_fetch_ts || ts > _last_fetch_ts + seek_ahead_threshold)
         {
-            LOG_DEBUG(logger, "reconstruct and seek");
-            _raw_source = ffmpeg::open_media_source(_file);
-            _raw_source->seek(ts);
+            std::lock_guard lock{_decode_mutex};
+            frame = decode_frame_at(ts);
         }
 
-        const auto [frame, fetch_count] = skip_frames_until(ts);
+        if (!frame)
+        {
+            LOG_DEBUG(logger, "no frame at, ts = {}", ts / 1.0s);
+            return {};
+        }
 
-        LOG_DEBUG(logger, "return frame_at, fetch_count = {}, ts = {}", fetch_count, core::timestamp{frame->pts} / 1.0s);
+        LOG_DEBUG(logger, "return frame_at, ts = {}", core::timestamp{frame->pts} / 1.0s);
 
         _last_req_ts = req_ts;
-        _last_fetch_ts = _last_ret_ts = core::timestamp{frame->pts};
+        _last_ret_ts = core::timestamp{frame->pts};
 
-        if (frame)
-            cache[ts.count()] = av_frame_clone(frame);
+        cache.put(_file.path, ts, frame);
 
         return frame;
     }
 
-    std::pair<AVFrame*, int> SyncMediaSource::skip_frames_until(core::timestamp ts)
+    void SyncMediaSource::switch_to_proxy()
+    {
+        LOG_INFO(logger, "Switch to proxy, path = {}", _file.path);
+
+        // Whatever the read-ahead step is after refers to the original
+        {
+            std::lock_guard lock{_read_ahead_mutex};
+
+            ++_read_ahead_generation;
+            _read_ahead_step = 0s;
+        }
+
+        std::lock_guard lock{_decode_mutex};
+
+        _reverse_decoder.reset();
+
+        auto &pool = get_decoder_pool();
+        pool.add_user(_proxy->media.path);
+        pool.remove_user(_file.path);
+
+        // The cache is keyed by path, so frames of the original are simply no longer hit
+        _file = _proxy->media;
+        _using_proxy = true;
+
+        _last_req_ts = 0s;
+        _last_ret_ts = 0s;
+    }
+
+    FrameRef SyncMediaSource::decode_frame_at(core::timestamp ts)
     {
-        AVFrame *frame{nullptr};
-        core::timestamp frame_ts;
-        size_t fetch_count = 0;
+        auto decoder = get_decoder_pool().acquire(_file, ts);
+
+        if (!decoder)
+            return {};
+
+        return decoder->frame_at(ts);
+    }
+
+    void SyncMediaSource::update_read_ahead(core::timestamp ts, bool cache_hit)
+    {
+        std::lock_guard lock{_read_ahead_mutex};
+
+        if (!_read_ahead_enabled)
+            return;
+
+        const auto step = ts - _playhead;
 
-        // Get next frame which aligns with current timestamp
-        do
+        if (step > 0s && step <= max_read_ahead_step)
         {
-            if (frame)
-                av_frame_unref(frame);
+            // Playing forward, the worker couldn't keep up if we missed
+            if (!cache_hit)
+            {
+                _read_ahead_depth = std::min(_read_ahead_depth * 2, max_read_ahead_depth);
+                _read_ahead_hits = 0;
+            }
+            else if (++_read_ahead_hits >= 2 * _read_ahead_depth)
+            {
+                _read_ahead_depth = std::max(_read_ahead_depth - 1, min_read_ahead_depth);
+                _read_ahead_hits = 0;
+            }
 
-            frame = _raw_source->next_frame(AVMEDIA_TYPE_VIDEO);
-            ++fetch_count;
+            _read_ahead_step = step;
+            _read_ahead_ts = std::max(_read_ahead_ts, ts + step);
+        }
+        else if (step != 0s)
+        {
+            // Seeked, cancel whatever is being read and wait until playback resumes
+            ++_read_ahead_generation;
+            _read_ahead_step = 0s;
+            _read_ahead_ts = ts;
+        }
 
-            if (!frame) // Early EOF
+        _playhead = ts;
+        queue_read_ahead();
+    }
+
+    bool SyncMediaSource::has_read_ahead_work() const
+    {
+        const auto limit = _playhead + _read_ahead_step * (int64_t)_read_ahead_depth;
+        return _read_ahead_step > 0s && _read_ahead_ts <= limit;
+    }
+
+    void SyncMediaSource::queue_read_ahead()
+    {
+        if (!_read_ahead_enabled || _read_ahead_queued || !has_read_ahead_work())
+            return;
+
+        _read_ahead_queued = true;
+        get_read_ahead_queue().push(this, [this] { read_ahead_step(); });
+    }
+
+    void SyncMediaSource::read_ahead_step()
+    {
+        auto &cache = get_frame_cache();
+
+        core::timestamp ts;
+        uint64_t generation;
+
+        {
+            std::lock_guard lock{_read_ahead_mutex};
+
+            // The playhead may have jumped back since this was queued
+            if (!has_read_ahead_work())
+            {
+                _read_ahead_queued = false;
+                return;
+            }
+
+            ts = _read_ahead_ts;
+            generation = _read_ahead_generation;
+        }
+
+        bool eof{false};
+
+        {
+            std::lock_guard decode_lock{_decode_mutex};
+
+            // Skip if a seek came in while waiting for the decoder
+            if (generation == _read_ahead_generation && !cache.contains(_file.path, ts))
             {
-                return {nullptr, fetch_count};
+                LOG_TRACE_L1(logger, "read ahead, ts = {}s", ts / 1.0s);
+
+                if (auto frame = decode_frame_at(ts))
+                {
+                    cache.put(_file.path, ts, frame);
+                }
+                else
+                {
+                    eof = true;
+                }
             }
+        }
+
+        std::lock_guard lock{_read_ahead_mutex};
 
-            frame_ts = core::timestamp(frame->pts);
+        if (generation == _read_ahead_generation && _read_ahead_ts == ts)
+        {
+            if (eof)
+                _read_ahead_step = 0s;
+            else
+                _read_ahead_ts = ts + _read_ahead_step;
         }
-        while (frame_ts < ts);
 
-        return {frame, fetch_count};
+        // Requeue at the back, so sources playing at once take turns
+        _read_ahead_queued = false;
+        queue_read_ahead();
     }
-}
 
+    bool SyncMediaSource::is_reverse_step(core::timestamp req_ts) const
+    {
+        if (_file.type == core::MediaFile::STATIC_IMAGE)
+            return false;
+
+        return req_ts < _last_req_ts && (_last_req_ts - req_ts) <= reverse_step_threshold;
+    }
+}
@@ -0,0 +1,77 @@
+#include "core/task_queue.h"
+#include "logging.h"
+
+#include <algorithm>
+
+static auto logger = logging::get_logger("TaskQueue");
+
+namespace core
+{
+    TaskQueue::TaskQueue(size_t num_threads)
+    {
+        LOG_DEBUG(logger, "Creating TaskQueue, threads = {}", num_threads);
+
+        for (size_t i = 0; i < num_threads; i++)
+            _threads.emplace_back([this] { run(); });
+    }
+
+    TaskQueue::~TaskQueue()
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _stopped = true;
+        }
+
+        _jobs_cv.notify_all();
+
+        for (auto &thread : _threads)
+            thread.join();
+    }
+
+    void TaskQueue::push(const void *owner, Task task)
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _jobs.push_back(Job{owner, std::move(task)});
+        }
+
+        _jobs_cv.notify_one();
+    }
+
+    void TaskQueue::remove(const void *owner)
+    {
+        std::unique_lock lock{_mutex};
+
+        _jobs.erase(std::remove_if(_jobs.begin(), _jobs.end(), [owner](const Job &job) {
+            return job.owner == owner;
+        }), _jobs.end());
+
+        _done_cv.wait(lock, [this, owner] {
+            return std::find(_running.begin(), _running.end(), owner) == _running.end();
+        });
+    }
+
+    void TaskQueue::run()
+    {
+        std::unique_lock lock{_mutex};
+
+        while (1)
+        {
+            _jobs_cv.wait(lock, [this] { return _stopped || !_jobs.empty(); });
+
+            if (_stopped)
+                break;
+
+            auto job = std::move(_jobs.front());
+            _jobs.pop_front();
+            _running.push_back(job.owner);
+
+            lock.unlock();
+            job.task();
+            lock.lock();
+
+            _running.erase(std::find(_running.begin(), _running.end(), job.owner));
+            _done_cv.notify_all();
+        }
+    }
+}
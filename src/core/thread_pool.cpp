@@ -0,0 +1,141 @@
+#include "core/thread_pool.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+static auto logger = logging::get_logger("ThreadPool");
+
+namespace core
+{
+    ThreadPool::ThreadPool(size_t num_threads)
+    {
+        LOG_INFO(logger, "Creating ThreadPool, threads = {}", num_threads);
+
+        for (size_t i = 0; i < num_threads; i++)
+            _threads.emplace_back([this] { run(); });
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _stopped = true;
+        }
+
+        _cv.notify_all();
+
+        for (auto &thread : _threads)
+            thread.join();
+    }
+
+    void ThreadPool::parallel_for(size_t n, const std::function<void(size_t)> &fn)
+    {
+        if (n == 0)
+            return;
+
+        if (n == 1 || _threads.empty())
+        {
+            for (size_t i = 0; i < n; i++)
+                fn(i);
+
+            return;
+        }
+
+        // Shared with the helper tasks, which may only get to run after we're done
+        struct Batch
+        {
+            const std::function<void(size_t)> *fn;
+            size_t n;
+            std::atomic<size_t> next{0};
+            size_t finished{0};
+            std::exception_ptr error;
+            std::mutex mutex;
+            std::condition_variable cv;
+        };
+
+        auto batch = std::make_shared<Batch>();
+        batch->fn = &fn;
+        batch->n = n;
+
+        // Claim items until there are none left
+        const auto work = [batch] {
+            size_t count = 0;
+            std::exception_ptr error;
+
+            for (size_t i; (i = batch->next++) < batch->n; count++)
+            {
+                try
+                {
+                    (*batch->fn)(i);
+                }
+                catch (...)
+                {
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+
+            if (count == 0)
+                return;
+
+            std::lock_guard lock{batch->mutex};
+
+            if (error && !batch->error)
+                batch->error = error;
+
+            batch->finished += count;
+
+            if (batch->finished == batch->n)
+                batch->cv.notify_all();
+        };
+
+        {
+            std::lock_guard lock{_mutex};
+
+            const size_t helpers = std::min(n - 1, _threads.size());
+
+            for (size_t i = 0; i < helpers; i++)
+                _tasks.emplace_back(work);
+        }
+
+        _cv.notify_all();
+
+        work();
+
+        std::unique_lock lock{batch->mutex};
+        batch->cv.wait(lock, [&batch] { return batch->finished == batch->n; });
+
+        if (batch->error)
+            std::rethrow_exception(batch->error);
+    }
+
+    void ThreadPool::run()
+    {
+        std::unique_lock lock{_mutex};
+
+        while (1)
+        {
+            _cv.wait(lock, [this] { return _stopped || !_tasks.empty(); });
+
+            if (_stopped)
+                break;
+
+            auto task = std::move(_tasks.front());
+            _tasks.pop_front();
+
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    ThreadPool &get_thread_pool()
+    {
+        static ThreadPool pool{std::max(1u, std::thread::hardware_concurrency()) - 1};
+
+        return pool;
+    }
+}
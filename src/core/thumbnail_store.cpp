@@ -0,0 +1,349 @@
+#include "core/thumbnail_store.h"
+#include "core/cache_dir.h"
+#include "core/media_file.h"
+#include "ffmpeg/frame_converter.h"
+#include "ffmpeg/media_source.h"
+#include "logging.h"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static auto logger = logging::get_logger("ThumbnailStore");
+
+namespace core
+{
+    namespace fs = std::filesystem;
+
+    // Slots allocated when a file is created, the count doubles when it runs out
+    static constexpr size_t initial_capacity = 16;
+
+    static constexpr char file_magic[4] = {'V', 'T', 'H', 'B'};
+    static constexpr uint32_t file_version = 1;
+
+    class ThumbnailStore::File
+    {
+    public:
+        File(const fs::path &path)
+        {
+            _fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+
+            if (_fd < 0)
+                throw fmt::system_error(errno, "Cannot open {}", path.string());
+
+            struct stat st;
+            fstat(_fd, &st);
+
+            const size_t size = st.st_size;
+            Header header{};
+
+            const bool valid = size >= sizeof(Header)
+                && pread(_fd, &header, sizeof header, 0) == sizeof header
+                && std::memcmp(header.magic, file_magic, sizeof file_magic) == 0
+                && header.version == file_version
+                && header.slot_size == slot_size
+                && size >= sizeof(Header) + header.count * slot_size;
+
+            if (!valid)
+            {
+                LOG_DEBUG(logger, "Creating thumbnail file, path = {}", path.string());
+
+                if (ftruncate(_fd, 0) != 0)
+                    throw fmt::system_error(errno, "ftruncate");
+
+                map(initial_capacity);
+
+                std::memcpy(get_header().magic, file_magic, sizeof file_magic);
+                get_header().version = file_version;
+                get_header().slot_size = slot_size;
+                get_header().count = 0;
+
+                return;
+            }
+
+            // A valid file may not hold a single full slot yet
+            map(std::max((size - sizeof(Header)) / slot_size, initial_capacity));
+
+            for (size_t i = 0; i < header.count; i++)
+            {
+                const auto *slot = get_slot(i);
+                _slots.emplace(reinterpret_cast<const SlotHeader*>(slot)->ts, slot);
+            }
+
+            LOG_DEBUG(logger, "Opened thumbnail file, path = {}, count = {}", path.string(), header.count);
+        }
+
+        ~File()
+        {
+            for (const auto &[addr, size] : _mappings)
+                munmap(addr, size);
+
+            close(_fd);
+        }
+
+        std::optional<Thumbnail> find(core::timestamp ts) const
+        {
+            const auto it = _slots.find(ts.count());
+
+            if (it == _slots.end())
+                return {};
+
+            const auto *slot = reinterpret_cast<const SlotHeader*>(it->second);
+
+            return Thumbnail{ts, slot->width, slot->height, it->second + sizeof(SlotHeader)};
+        }
+
+        void add(core::timestamp ts, int width, int height, const uint8_t *pixels)
+        {
+            const size_t count = get_header().count;
+
+            if (count >= _capacity)
+                map(std::max(_capacity * 2, initial_capacity));
+
+            auto *slot = get_slot(count);
+
+            SlotHeader slot_header{ts.count(), width, height};
+            std::memcpy(slot, &slot_header, sizeof slot_header);
+            std::memcpy(slot + sizeof slot_header, pixels, width * height * 3);
+
+            // Published only once written, a crash leaves at most an unused slot
+            get_header().count = count + 1;
+
+            _slots.emplace(ts.count(), slot);
+        }
+
+    private:
+        struct Header
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t slot_size;
+            uint32_t count;
+        };
+
+        struct SlotHeader
+        {
+            int64_t ts;
+            int32_t width;
+            int32_t height;
+        };
+
+        static constexpr uint32_t slot_size = sizeof(SlotHeader) + max_width * max_height * 3;
+
+        int _fd{-1};
+        uint8_t *_data{nullptr};
+        size_t _capacity{0};
+
+        // Outgrown mappings stay around, handed out thumbnails point into them
+        std::vector<std::pair<void*, size_t>> _mappings;
+
+        std::unordered_map<core::timestamp::rep, const uint8_t*> _slots;
+
+        Header &get_header()
+        {
+            return *reinterpret_cast<Header*>(_data);
+        }
+
+        uint8_t *get_slot(size_t i)
+        {
+            return _data + sizeof(Header) + i * slot_size;
+        }
+
+        void map(size_t capacity)
+        {
+            const size_t size = sizeof(Header) + capacity * slot_size;
+
+            struct stat st;
+            fstat(_fd, &st);
+
+            if ((size_t)st.st_size < size && ftruncate(_fd, size) != 0)
+                throw fmt::system_error(errno, "ftruncate");
+
+            void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+
+            if (addr == MAP_FAILED)
+                throw fmt::system_error(errno, "mmap");
+
+            _mappings.emplace_back(addr, size);
+            _data = static_cast<uint8_t*>(addr);
+            _capacity = capacity;
+        }
+    };
+
+    ThumbnailStore::ThumbnailStore(fs::path dir):
+        _dir(std::move(dir))
+    {
+        LOG_INFO(logger, "Creating ThumbnailStore, dir = {}", _dir.string());
+
+        fs::create_directories(_dir);
+
+        _thread = std::thread{[this] { run(); }};
+    }
+
+    ThumbnailStore::~ThumbnailStore()
+    {
+        {
+            std::lock_guard lock{_mutex};
+            _stopped = true;
+        }
+
+        _cv.notify_all();
+        _thread.join();
+    }
+
+    std::optional<ThumbnailStore::Thumbnail> ThumbnailStore::get(const std::string &path, core::timestamp ts)
+    {
+        ts -= ts % core::timestamp{interval};
+
+        std::lock_guard lock{_mutex};
+
+        if (auto *file = get_file(path, false))
+        {
+            if (auto thumbnail = file->find(ts))
+                return thumbnail;
+        }
+
+        Request request{path, ts};
+
+        if (_failed.count(request) == 0 && _pending.insert(request).second)
+        {
+            _requests.push_back(std::move(request));
+            _cv.notify_all();
+        }
+
+        return {};
+    }
+
+    ThumbnailStore::File *ThumbnailStore::get_file(const std::string &path, bool create)
+    {
+        const auto it = _files.find(path);
+
+        if (it != _files.end() && (it->second || !create))
+            return it->second.get();
+
+        std::error_code ec;
+        const auto mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+
+        const auto key = fmt::format("{}:{}", path, mtime);
+        const auto file_path = _dir / fmt::format("{:016x}.thumbs", std::hash<std::string>{}(key));
+
+        std::unique_ptr<File> file;
+
+        try
+        {
+            // Files which don't decode shouldn't leave anything behind
+            if (create || fs::exists(file_path))
+                file = std::make_unique<File>(file_path);
+        }
+        catch (const std::exception &ex)
+        {
+            LOG_WARNING(logger, "Cannot open thumbnail file, what = {}", ex.what());
+        }
+
+        auto &entry = _files[path];
+        entry = std::move(file);
+
+        return entry.get();
+    }
+
+    void ThumbnailStore::run()
+    {
+        std::unique_lock lock{_mutex};
+
+        while (1)
+        {
+            _cv.wait(lock, [this] { return _stopped || !_requests.empty(); });
+
+            if (_stopped)
+                break;
+
+            // Latest first, that's what is on screen
+            const auto request = std::move(_requests.back());
+            _requests.pop_back();
+
+            lock.unlock();
+
+            bool ok{false};
+
+            try
+            {
+                ok = generate(request);
+            }
+            catch (const std::exception &ex)
+            {
+                LOG_WARNING(logger, "Cannot generate thumbnail, path = {}, what = {}", request.path, ex.what());
+            }
+
+            lock.lock();
+
+            if (!ok)
+                _failed.insert(request);
+
+            _pending.erase(request);
+        }
+    }
+
+    bool ThumbnailStore::generate(const Request &request)
+    {
+        LOG_TRACE_L1(logger, "Generate thumbnail, path = {}, ts = {}s", request.path, request.ts / 1.0s);
+
+        if (request.path != _source_path)
+        {
+            _source = ffmpeg::open_media_source(core::MediaFile{core::MediaFile::VIDEO, request.path});
+            _source_path = request.path;
+        }
+
+        if (!_source || !_source->has_stream(AVMEDIA_TYPE_VIDEO) || !_source->seek(request.ts))
+            return false;
+
+        auto frame = _source->next_frame(AVMEDIA_TYPE_VIDEO);
+
+        while (frame && core::timestamp{frame->pts} < request.ts)
+            frame = _source->next_frame(AVMEDIA_TYPE_VIDEO);
+
+        if (!frame)
+            return false;
+
+        const float scale = std::min((float)max_width / frame->width, (float)max_height / frame->height);
+        const int width = std::clamp((int)(frame->width * scale), 1, max_width);
+        const int height = std::clamp((int)(frame->height * scale), 1, max_height);
+
+        ffmpeg::FrameConverter converter{AV_PIX_FMT_RGB24};
+        AVFrame *rgb_frame = converter.convert(frame.get(), width, height);
+        frame.reset();
+
+        // Drop the row padding
+        std::vector<uint8_t> pixels(width * height * 3);
+
+        for (int i = 0; i < height; i++)
+            std::memcpy(&pixels[i * width * 3], rgb_frame->data[0] + i * rgb_frame->linesize[0], width * 3);
+
+        av_frame_free(&rgb_frame);
+
+        std::lock_guard lock{_mutex};
+
+        auto *file = get_file(request.path, true);
+
+        if (!file)
+            return false;
+
+        file->add(request.ts, width, height, pixels.data());
+
+        return true;
+    }
+
+    ThumbnailStore &get_thumbnail_store()
+    {
+        static ThumbnailStore store{get_cache_dir() / "thumbnails"};
+
+        return store;
+    }
+}
@@ -1,5 +1,7 @@
 #include "core/timeline.h"
 
+#include <algorithm>
+
 namespace core
 {
     std::pair<core::timestamp, core::timestamp> Timeline::Track::bounds() const
@@ -114,6 +116,14 @@ namespace core
         timeline->clip_transformed_event.notify(clip);
     }
 
+    void Timeline::Track::fade_clip(Clip &clip, float d_opacity)
+    {
+        auto &xform = const_cast<ClipTransform&>(*clip.transforms.begin());
+        xform.opacity = std::clamp(xform.opacity + d_opacity, 0.0f, 1.0f);
+
+        timeline->clip_transformed_event.notify(clip);
+    }
+
     Timeline::Timeline(WorkspaceProperties &props):
         _props(props)
     {
@@ -1,11 +1,29 @@
 #include "core/video_composer.h"
+#include "core/pixel_ops.h"
+#include "core/thread_pool.h"
+#include "ffmpeg/frame_pool.h"
 #include "logging.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
 #include <algorithm>
+#include <cstring>
+#include <functional>
 
 static auto logger = logging::get_logger("VideoComposer");
 
 namespace core
 {
+    // Fewest output rows composed by one task, so small frames aren't split up
+    static constexpr int min_band_rows = 32;
+    static constexpr int bands_per_thread = 2;
+
+    // Only sources of clips this close to the position read ahead, so a long
+    // timeline doesn't have every clip competing for the read-ahead workers
+    static constexpr auto read_ahead_window = 2s;
+
     static std::pair<ClipTransform, ClipTransform> find_current_clip_transforms(const Timeline::Clip &clip, const core::timestamp ts)
     {
         assert(!clip.transforms.empty());
@@ -29,31 +47,82 @@ namespace core
         return {*it, *it2};
     }
 
-    static void blit_pixels(AVFrame *dst_frame, AVFrame *src_frame, int dst_x, int dst_y)
+    static void for_each_band(AVFrame *frame, const std::function<void(int, int)> &fn)
     {
-        const auto dst_stride = dst_frame->linesize[0];
-        const auto src_stride = src_frame->linesize[0];
-        unsigned char *dst = dst_frame->data[0];
-        const unsigned char *src = src_frame->data[0];
+        auto &pool = get_thread_pool();
+
+        // Bands of whole rows keep every worker writing to memory of its own,
+        // a few more bands than threads evens out clips covering only part of the frame
+        const int max_bands = std::max(1, frame->height / min_band_rows);
+        const int num_bands = std::min(max_bands, (int)(pool.size() + 1) * bands_per_thread);
+        const int band_rows = (frame->height + num_bands - 1) / num_bands;
+
+        pool.parallel_for(num_bands, [&](size_t band) {
+            const int rows_begin = (int)band * band_rows;
+            const int rows_end = std::min(rows_begin + band_rows, frame->height);
+
+            fn(rows_begin, rows_end);
+        });
+    }
 
-        for (int i = 0; i < src_frame->height; i++)
+    // Transparent black in premultiplied RGBA, plain black in other formats
+    static void clear_frame(AVFrame *out_frame)
+    {
+        if (out_frame->format != AV_PIX_FMT_RGBA)
         {
-            for (int j = 0; j < src_frame->width; j++)
-            {
-                int dst_i = i + dst_y;
-                int dst_j = j + dst_x;
+            const ptrdiff_t linesize[4] = {out_frame->linesize[0], out_frame->linesize[1], out_frame->linesize[2], out_frame->linesize[3]};
 
-                if (dst_i < 0 || dst_i >= dst_frame->height)
-                    continue;
+            av_image_fill_black(out_frame->data, linesize, (AVPixelFormat)out_frame->format, AVCOL_RANGE_MPEG, out_frame->width, out_frame->height);
+            return;
+        }
 
-                if (dst_j < 0 || dst_j >= dst_frame->width)
-                    continue;
+        for_each_band(out_frame, [out_frame](int rows_begin, int rows_end) {
+            clear_rgba(out_frame, {0, rows_begin, out_frame->width, rows_end});
+        });
+    }
 
-                dst[dst_i * dst_stride + dst_j * 3 + 0] = src[i * src_stride + j * 3 + 0];
-                dst[dst_i * dst_stride + dst_j * 3 + 1] = src[i * src_stride + j * 3 + 1];
-                dst[dst_i * dst_stride + dst_j * 3 + 2] = src[i * src_stride + j * 3 + 2];
-            }
+    static bool has_alpha(AVPixelFormat format)
+    {
+        const auto *desc = av_pix_fmt_desc_get(format);
+
+        return desc && (desc->flags & AV_PIX_FMT_FLAG_ALPHA);
+    }
+
+    static void hash_combine(uint64_t &seed, uint64_t value)
+    {
+        seed ^= value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+    }
+
+    static uint64_t hash_float(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        return bits;
+    }
+
+    // Everything about a clip which affects the frames composed from it
+    static uint64_t hash_clip(const Timeline::Clip &clip)
+    {
+        uint64_t seed = std::hash<std::string>{}(clip.file.path);
+
+        hash_combine(seed, clip.id);
+        hash_combine(seed, clip.position.count());
+        hash_combine(seed, clip.start_time.count());
+        hash_combine(seed, clip.duration.count());
+
+        for (const auto &xform : clip.transforms)
+        {
+            hash_combine(seed, xform.rel_position.count());
+            hash_combine(seed, hash_float(xform.translate_x));
+            hash_combine(seed, hash_float(xform.translate_y));
+            hash_combine(seed, hash_float(xform.scale_x));
+            hash_combine(seed, hash_float(xform.scale_y));
+            hash_combine(seed, hash_float(xform.rotation));
+            hash_combine(seed, hash_float(xform.opacity));
         }
+
+        return seed;
     }
 
     VideoComposer::VideoComposer(core::Timeline &timeline, WorkspaceProperties props):
@@ -78,14 +147,24 @@ namespace core
     {
         _props = std::move(props);
         _frame_dt = _props.frame_dt();
+
+        if (_memo)
+            _memo->clear();
     }
 
     void VideoComposer::update_track(core::Timeline::Track &track)
     {
         LOG_DEBUG(logger, "update track, num_clips = {}", track.clips.size());
 
-        if (_tracks.find(track.id) != _tracks.end())
+        if (const auto it = _tracks.find(track.id); it != _tracks.end())
+        {
+            invalidate_changes(&it->second, &track);
             rm_track(track.id);
+        }
+        else
+        {
+            invalidate_changes(nullptr, &track);
+        }
 
         add_track(track);
 
@@ -120,8 +199,100 @@ namespace core
 
     void VideoComposer::remove_track(core::Timeline::TrackID id)
     {
-        if (_tracks.find(id) != _tracks.end())
-            _tracks.erase(id);
+        if (const auto it = _tracks.find(id); it != _tracks.end())
+        {
+            invalidate_changes(&it->second, nullptr);
+            _tracks.erase(it);
+        }
+    }
+
+    void VideoComposer::invalidate_changes(const Timeline::Track *old_track, const Timeline::Track *new_track)
+    {
+        if (!_memo)
+            return;
+
+        const auto invalidate_changed = [this](const Timeline::Track *track, const Timeline::Track *other) {
+            if (!track)
+                return;
+
+            for (const auto &[clip_id, clip] : track->clips)
+            {
+                if (other)
+                {
+                    const auto it = other->clips.find(clip_id);
+
+                    if (it != other->clips.end() && hash_clip(it->second) == hash_clip(clip))
+                        continue;
+                }
+
+                _memo->invalidate(clip.position, clip.end_position());
+            }
+        };
+
+        // Both where a changed clip used to be and where it is now
+        invalidate_changed(old_track, new_track);
+        invalidate_changed(new_track, old_track);
+    }
+
+    void VideoComposer::set_reverse(bool reverse)
+    {
+        _reverse = reverse;
+    }
+
+    void VideoComposer::set_native_format(AVPixelFormat format)
+    {
+        LOG_INFO(logger, "Set native format, format = {}", av_get_pix_fmt_name(format));
+
+        _native_format = format;
+
+        if (_memo)
+            _memo->clear();
+    }
+
+    void VideoComposer::set_memoize(bool enabled)
+    {
+        if (enabled && !_memo)
+            _memo = std::make_unique<CompositionCache>(get_composition_cache_budget());
+        else if (!enabled)
+            _memo.reset();
+    }
+
+    void VideoComposer::set_retain_layers(bool enabled)
+    {
+        _retain = enabled;
+
+        if (!enabled)
+            _retained.reset();
+    }
+
+    void VideoComposer::set_read_ahead(bool enabled)
+    {
+        _read_ahead = enabled;
+
+        // Enabled per source by next_frame, depending on the position
+        if (!enabled)
+        {
+            for (auto &[clip_id, source] : _sources)
+                source.set_read_ahead(false);
+        }
+    }
+
+    void VideoComposer::update_read_ahead(core::timestamp ts)
+    {
+        for (auto &[track_id, track] : _tracks)
+        {
+            for (auto &[clip_id, clip] : track.clips)
+            {
+                auto it = _sources.find(clip_id);
+
+                if (it == _sources.end())
+                    continue;
+
+                const bool near = clip.position <= ts + read_ahead_window &&
+                                  clip.end_position() + read_ahead_window > ts;
+                it->second.set_read_ahead(near);
+            }
+        }
     }
 
     std::string VideoComposer::get_name()
@@ -148,26 +319,192 @@ namespace core
         return false;
     }
 
-    AVFrame* VideoComposer::next_frame(AVMediaType frame_type)
+    FrameRef VideoComposer::next_frame(AVMediaType frame_type)
     {
         auto &ts = _composition->last_position;
 
-        AVFrame *out_frame = av_frame_alloc();
-        out_frame->pts = ts.count();
-        out_frame->duration = _frame_dt.count();
+        const int width = _props.video.width;
+        const int height = _props.video.height;
 
-        out_frame->width = _props.video.width;
-        out_frame->height = _props.video.height;
-        out_frame->format = AVPixelFormat::AV_PIX_FMT_RGB24;
+        LOG_DEBUG(logger, "Next frame, ts = {}s", ts / 1.0s);
+        LOG_TRACE_L3(logger, "Begin compose");
 
-        if (av_frame_get_buffer(out_frame, 0) != 0)
-            throw std::runtime_error("av_frame_get_buffer @ render");
+        if (_read_ahead)
+            update_read_ahead(ts);
 
-        // Zero out frame
-        memset(out_frame->data[0], 0, out_frame->linesize[0] * out_frame->height);
+        auto layers = collect_layers(ts, width, height);
 
-        LOG_DEBUG(logger, "Next frame, ts = {}s", ts / 1.0s);
-        LOG_TRACE_L3(logger, "Begin compose");
+        FrameRef out_frame;
+        uint64_t key{0};
+
+        if (_memo)
+        {
+            key = content_key(layers, width, height);
+            out_frame = _memo->get(ts, key);
+        }
+
+        if (out_frame)
+        {
+            LOG_TRACE_L1(logger, "Composed frame memoized, ts = {}s", ts / 1.0s);
+        }
+        else
+        {
+            // Only transforms changed since the frame shown after the last seek,
+            // redraw just the parts the changed layers moved away from or onto
+            if (_retained && _retained->ts == ts)
+                out_frame = recompose(ts, layers);
+
+            if (!out_frame)
+                out_frame = compose_frame(ts, layers, width, height);
+
+            out_frame->pts = ts.count();
+            out_frame->duration = _frame_dt.count();
+
+            if (_memo)
+                _memo->put(ts, key, out_frame);
+
+            // Keep the layers of the frame which stays on screen while paused
+            if (_retain && ts == _composition->start_position && out_frame->format == AV_PIX_FMT_RGBA)
+                _retained = std::make_unique<Retained>(Retained{ts, std::move(layers), out_frame.share()});
+        }
+
+        LOG_TRACE_L3(logger, "End compose");
+
+        if (_reverse)
+            ts = std::max(ts - _frame_dt, core::timestamp{0s});
+        else
+            ts += _frame_dt;
+
+        return out_frame;
+    }
+
+    FrameRef VideoComposer::compose_frame(core::timestamp ts, std::vector<Layer> &layers, int width, int height)
+    {
+        // Clips hidden under opaque ones aren't fetched at all, their sources
+        // pick up from wherever they're needed once visible again
+        const bool culled = cull_hidden_layers(layers, width, height);
+
+        // Plain cuts need no blending, so they're composed in the format
+        // wanted downstream, which spares converting to RGBA and back
+        const auto format = can_compose_native(layers, width, height)
+            ? _native_format
+            : AV_PIX_FMT_RGBA;
+
+        FrameRef out_frame{ffmpeg::get_frame_pool().get(format, width, height)};
+
+        // A clip turned out not to be opaque, the frame was left half drawn,
+        // so draw it again in RGBA without hiding anything
+        if (!compose(out_frame.get(), ts, layers))
+        {
+            LOG_DEBUG(logger, "Clip not opaque after all, compose again, ts = {}s, culled = {}", ts / 1.0s, culled);
+
+            out_frame = FrameRef{ffmpeg::get_frame_pool().get(AV_PIX_FMT_RGBA, width, height)};
+
+            layers = collect_layers(ts, width, height);
+            compose(out_frame.get(), ts, layers);
+        }
+
+        return out_frame;
+    }
+
+    FrameRef VideoComposer::recompose(core::timestamp ts, std::vector<Layer> &layers)
+    {
+        auto &retained = *_retained;
+        const auto *prev_frame = retained.frame.get();
+
+        if (prev_frame->width != _props.video.width || prev_frame->height != _props.video.height)
+            return {};
+
+        if (layers.size() != retained.layers.size())
+            return {};
+
+        const Rect canvas{0, 0, prev_frame->width, prev_frame->height};
+        Rect damage{0, 0, 0, 0};
+
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            auto &layer = layers[i];
+            auto &prev = retained.layers[i];
+
+            // A different clip or frame at this level, or one of unknown size
+            if (layer.clip_id != prev.clip_id || layer.source_ts != prev.source_ts)
+                return {};
+
+            if (layer.width <= 0 || layer.height <= 0)
+                return {};
+
+            const bool resized = (layer.width != prev.width || layer.height != prev.height);
+            const bool changed = resized || layer.x != prev.x || layer.y != prev.y
+                || layer.xform.rotation != prev.xform.rotation || layer.opacity != prev.opacity;
+
+            if (changed)
+                damage = damage.united(prev.bounds()).united(layer.bounds());
+
+            // Take over whatever was fetched and converted for the previous frame,
+            // a converted frame of the wrong size is made again from the decoded one
+            layer.hidden = prev.hidden;
+            layer.clip_frame = std::move(prev.clip_frame);
+
+            if (!resized && prev.frame && prev.frame->width == layer.width && prev.frame->height == layer.height)
+                layer.frame = std::move(prev.frame);
+
+            if (layer.clip_frame)
+                layer.opaque = !has_alpha((AVPixelFormat)layer.clip_frame->format) && layer.opacity >= 1.0f;
+            else if (layer.still && layer.still->frame)
+                layer.opaque = layer.still->opaque && layer.opacity >= 1.0f;
+        }
+
+        damage = damage.intersected(canvas);
+
+        if (damage.empty())
+            return retained.frame.share();
+
+        LOG_DEBUG(logger, "Recompose, ts = {}s, damage = {}x{} at ({}, {})", ts / 1.0s,
+                damage.x1 - damage.x0, damage.y1 - damage.y0, damage.x0, damage.y0);
+
+        FrameRef out_frame{ffmpeg::get_frame_pool().get(AV_PIX_FMT_RGBA, canvas.x1, canvas.y1)};
+
+        // Layers reaching into the damage need a frame to draw, previously
+        // hidden ones are fetched now
+        get_thread_pool().parallel_for(layers.size(), [&](size_t i) {
+            auto &layer = layers[i];
+
+            if (layer.frame || layer.bounds().intersected(damage).empty())
+                return;
+
+            if (layer.hidden || layer.still)
+            {
+                layer.hidden = false;
+                prepare_layer(layer, out_frame.get());
+            }
+            else if (layer.clip_frame)
+            {
+                convert_layer(layer, layer.clip_frame.get());
+            }
+        });
+
+        for_each_band(out_frame.get(), [&](int rows_begin, int rows_end) {
+            const auto *src = prev_frame->data[0] + rows_begin * prev_frame->linesize[0];
+            auto *dst = out_frame->data[0] + rows_begin * out_frame->linesize[0];
+
+            av_image_copy_plane(dst, out_frame->linesize[0], src, prev_frame->linesize[0], canvas.x1 * 4, rows_end - rows_begin);
+
+            const auto area = damage.intersected({canvas.x0, rows_begin, canvas.x1, rows_end});
+
+            if (area.empty())
+                return;
+
+            clear_rgba(out_frame.get(), area);
+            compose_layers(out_frame.get(), layers, area);
+        });
+
+        return out_frame;
+    }
+
+    std::vector<VideoComposer::Layer> VideoComposer::collect_layers(core::timestamp ts, int out_width, int out_height)
+    {
+        // Tracks in z-order, later ones are drawn on top
+        std::vector<Layer> layers;
 
         for (auto &[track_id, track] : _tracks)
         {
@@ -177,40 +514,331 @@ namespace core
                 continue;
 
             auto &clip = track.clips[*clip_id];
-            auto &source = _sources.at(clip.id);
 
-            AVFrame *clip_frame = source.frame_at(ts - clip.position + clip.start_time);
+            // Only apply passed transform for now
+            // TODO: Implement transform interpolation with various functions
+            const auto [xform1, xform2] = find_current_clip_transforms(clip, ts);
+            const auto opacity = std::clamp(xform1.opacity, 0.0f, 1.0f);
 
-            if (!clip_frame)
+            if (opacity <= 0.0f) // Invisible, don't bother decoding
+                continue;
+
+            Layer layer{&clip, &_sources.at(clip.id), xform1, opacity};
+            layer.clip_id = clip.id;
+            layer.source_ts = ts - clip.position + clip.start_time;
+            layer.x = (int)(out_width * xform1.translate_x);
+            layer.y = (int)(out_height * xform1.translate_y);
+
+            // Size by the original file, frames may come from a smaller proxy
+            if (clip.file.width > 0 && clip.file.height > 0)
             {
-                LOG_DEBUG(logger, "No frame found");
+                layer.width = (int)(clip.file.width * xform1.scale_x);
+                layer.height = (int)(clip.file.height * xform1.scale_y);
+            }
+
+            // Still images are scaled once and kept in the output format
+            if (clip.file.type == MediaFile::STATIC_IMAGE)
+                layer.still = &_stills[clip.id];
+
+            layers.push_back(std::move(layer));
+        }
+
+        // Forget the stills which went out of view
+        for (auto it = _stills.begin(); it != _stills.end();)
+        {
+            const bool visible = std::any_of(layers.begin(), layers.end(), [&it](const Layer &layer) {
+                return layer.clip_id == it->first;
+            });
+
+            it = visible? std::next(it) : _stills.erase(it);
+        }
+
+        return layers;
+    }
+
+    uint64_t VideoComposer::content_key(const std::vector<Layer> &layers, int out_width, int out_height) const
+    {
+        uint64_t seed = _native_format;
+
+        hash_combine(seed, out_width);
+        hash_combine(seed, out_height);
+
+        // Layers are in z-order, so the key changes with it
+        for (const auto &layer : layers)
+        {
+            hash_combine(seed, layer.clip->track_id);
+            hash_combine(seed, hash_clip(*layer.clip));
+        }
+
+        return seed;
+    }
+
+    bool VideoComposer::cull_hidden_layers(std::vector<Layer> &layers, int out_width, int out_height)
+    {
+        // Opaque layers seen so far, going from the top down, and whether
+        // they hid anything below them
+        std::vector<std::pair<Layer*, bool>> occluders;
+        bool culled = false;
+
+        for (auto it = layers.rbegin(); it != layers.rend(); ++it)
+        {
+            auto &layer = *it;
+
+            if (layer.width <= 0 || layer.height <= 0) // Unknown size, can't tell
                 continue;
+
+            // Only the part on the canvas has to be covered
+            const auto bounds = layer.bounds();
+            const int x0 = std::max(bounds.x0, 0);
+            const int y0 = std::max(bounds.y0, 0);
+            const int x1 = std::min(bounds.x1, out_width);
+            const int y1 = std::min(bounds.y1, out_height);
+
+            const auto covering = std::find_if(occluders.begin(), occluders.end(), [&](const auto &occluder) {
+                const auto *above = occluder.first;
+                return above->x <= x0 && above->y <= y0 && above->x + above->width >= x1 && above->y + above->height >= y1;
+            });
+
+            if (covering != occluders.end())
+                covering->second = true;
+
+            const bool hidden = (x1 <= x0 || y1 <= y0) || covering != occluders.end();
+
+            if (hidden)
+            {
+                LOG_TRACE_L1(logger, "Cull hidden clip, id = {}", layer.clip->id);
+
+                layer.hidden = true;
+                culled = true;
             }
+            else if (layer.opacity >= 1.0f && !layer.clip->file.has_alpha && !layer.rotated())
+            {
+                occluders.emplace_back(&layer, false);
+            }
+        }
 
-            // Only apply passed transform for now
-            // TODO: Implement transform interpolation with various functions
-            const auto [xform1, xform2] = find_current_clip_transforms(clip, ts);
+        // Only those which hid something have to turn out opaque
+        for (auto &[layer, hid_something] : occluders)
+            layer->occluder = hid_something;
 
-            const auto target_x = (int)(out_frame->width * xform1.translate_x);
-            const auto target_y = (int)(out_frame->height * xform1.translate_y);
-            const auto target_width = (int)(clip_frame->width * xform1.scale_x);
-            const auto target_height = (int)(clip_frame->height * xform1.scale_y);
+        return culled;
+    }
 
-            auto &frame_converter = _frame_converters.at(track.id);
+    bool VideoComposer::compose(AVFrame *out_frame, core::timestamp ts, std::vector<Layer> &layers)
+    {
+        // Opaque clips can be scaled straight into the output frame while the
+        // sources are fetched, as long as they don't overlap anything drawn
+        // before them. Those which cover the whole frame also spare clearing it.
+        bool covered = false;
 
-            AVFrame *tmp_frame = frame_converter.convert(clip_frame, target_width, target_height);
-            av_frame_unref(clip_frame);
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            auto &layer = layers[i];
 
-            blit_pixels(out_frame, tmp_frame, target_x, target_y);
-            av_frame_unref(tmp_frame);
+            // Stills are blitted from their scaled copy instead
+            if (layer.hidden || layer.opacity < 1.0f || layer.width <= 0 || layer.height <= 0 || layer.rotated() || layer.still)
+                continue;
+
+            if (layer.x < 0 || layer.y < 0 || layer.x + layer.width > out_frame->width || layer.y + layer.height > out_frame->height)
+                continue;
+
+            const bool overlaps = std::any_of(layers.begin(), layers.begin() + i, [&layer](const Layer &below) {
+                return !below.hidden && below.overlaps(layer);
+            });
+
+            if (overlaps)
+                continue;
+
+            layer.direct = true;
+            covered |= (layer.width == out_frame->width && layer.height == out_frame->height);
         }
 
-        LOG_TRACE_L3(logger, "End compose");
+        if (!covered)
+            clear_frame(out_frame);
+
+        // Each layer has its own source and scaling contexts are leased per call,
+        // so fetching and scaling run concurrently, only compositing has to follow the z-order
+        get_thread_pool().parallel_for(layers.size(), [&](size_t i) {
+            if (!layers[i].hidden)
+                prepare_layer(layers[i], out_frame);
+        });
 
-        _composition->frames.push_back(out_frame); // TODO: remove this
-        ts += _frame_dt;
+        // Whatever an occluder was meant to hide shows if it came up empty or with alpha
+        const bool occluded = std::none_of(layers.begin(), layers.end(), [](const Layer &layer) {
+            return layer.occluder && !layer.opaque;
+        });
 
-        return out_frame;
+        if (!occluded)
+            return false;
+
+        const bool native = (out_frame->format != AV_PIX_FMT_RGBA);
+
+        // Nothing can be blended outside of RGBA
+        if (native && std::any_of(layers.begin(), layers.end(), [](const Layer &layer) { return layer.frame && !layer.opaque; }))
+            return false;
+
+        // The layer covering the frame may have turned out to have alpha
+        if (covered && std::none_of(layers.begin(), layers.end(), [](const Layer &layer) { return layer.direct; }))
+            clear_frame(out_frame);
+
+        if (native)
+        {
+            // Overlapping opaque clips simply overwrite each other in z-order
+            for (auto &layer : layers)
+            {
+                if (layer.frame)
+                    _converter.convert_into(layer.frame.get(), out_frame, layer.x, layer.y, layer.width, layer.height);
+            }
+        }
+        else
+        {
+            for_each_band(out_frame, [&](int rows_begin, int rows_end) {
+                compose_layers(out_frame, layers, {0, rows_begin, out_frame->width, rows_end});
+            });
+        }
+
+        return true;
+    }
+
+    bool VideoComposer::can_compose_native(const std::vector<Layer> &layers, int out_width, int out_height) const
+    {
+        if (_native_format == AV_PIX_FMT_NONE || _native_format == AV_PIX_FMT_RGBA)
+            return false;
+
+        const auto *desc = av_pix_fmt_desc_get(_native_format);
+
+        if (!desc || (desc->flags & AV_PIX_FMT_FLAG_ALPHA))
+            return false;
+
+        // Chroma planes can only be written from whole chroma samples
+        const int align_x = 1 << desc->log2_chroma_w;
+        const int align_y = 1 << desc->log2_chroma_h;
+
+        return std::all_of(layers.begin(), layers.end(), [&](const Layer &layer) {
+            if (layer.hidden)
+                return true;
+
+            if (layer.opacity < 1.0f || layer.rotated() || layer.clip->file.has_alpha)
+                return false;
+
+            if (layer.width <= 0 || layer.height <= 0)
+                return false;
+
+            if (layer.x < 0 || layer.y < 0 || layer.x + layer.width > out_width || layer.y + layer.height > out_height)
+                return false;
+
+            return layer.x % align_x == 0 && layer.y % align_y == 0 && layer.width % align_x == 0 && layer.height % align_y == 0;
+        });
+    }
+
+    void VideoComposer::compose_layers(AVFrame *out_frame, const std::vector<Layer> &layers, const Rect &area)
+    {
+        for (const auto &layer : layers)
+        {
+            // Skip layers already scaled into place, or with nothing to draw
+            const auto *frame = layer.frame.get();
+
+            if (!frame)
+                continue;
+
+            if (layer.rotated())
+            {
+                if (layer.bounds().intersected(area).empty())
+                    continue;
+
+                // Rotates and places the clip in one go, it's at its final size already
+                const auto map = place_rotated(frame->width, frame->height, layer.x, layer.y, layer.width, layer.height, layer.xform.rotation);
+                warp_over_rgba(out_frame, frame, map, layer.opacity, area);
+
+                continue;
+            }
+
+            // Skip layers which don't reach into this area
+            if (layer.y >= area.y1 || layer.y + frame->height <= area.y0)
+                continue;
+
+            // Nothing shows through opaque clips, copying is enough
+            if (layer.opaque)
+                blit_rgba(out_frame, frame, layer.x, layer.y, area);
+            else
+                blend_over_rgba(out_frame, frame, layer.x, layer.y, layer.opacity, area);
+        }
+    }
+
+    void VideoComposer::prepare_layer(Layer &layer, AVFrame *out_frame)
+    {
+        const auto format = (AVPixelFormat)out_frame->format;
+
+        if (layer.still && layer.still->matches(layer, format))
+        {
+            layer.frame = layer.still->frame.share();
+            layer.opaque = layer.still->opaque && layer.opacity >= 1.0f;
+
+            return;
+        }
+
+        auto clip_frame = layer.source->frame_at(layer.source_ts);
+
+        if (!clip_frame)
+        {
+            LOG_DEBUG(logger, "No frame found");
+            layer.direct = false;
+            return;
+        }
+
+        // Retained layers may have to be converted again later on
+        if (_retain)
+            layer.clip_frame = clip_frame.share();
+
+        if (layer.width <= 0 || layer.height <= 0)
+        {
+            layer.width = (int)(clip_frame->width * layer.xform.scale_x);
+            layer.height = (int)(clip_frame->height * layer.xform.scale_y);
+        }
+
+        layer.opaque = !has_alpha((AVPixelFormat)clip_frame->format) && layer.opacity >= 1.0f;
+        layer.direct &= layer.opaque;
+
+        if (layer.still)
+        {
+            prepare_still(layer, clip_frame.get(), format);
+        }
+        else if (out_frame->format != AV_PIX_FMT_RGBA && !layer.direct)
+        {
+            // Converted into place once the layers below are drawn
+            layer.frame = std::move(clip_frame);
+        }
+        else if (layer.direct)
+        {
+            _converter.convert_into(clip_frame.get(), out_frame, layer.x, layer.y, layer.width, layer.height);
+        }
+        else
+        {
+            convert_layer(layer, clip_frame.get());
+        }
+    }
+
+    void VideoComposer::prepare_still(Layer &layer, AVFrame *clip_frame, AVPixelFormat format)
+    {
+        LOG_DEBUG(logger, "Scale still, clip_id = {}, size = {}x{}", layer.clip_id, layer.width, layer.height);
+
+        FrameRef scaled{ffmpeg::get_frame_pool().get(format, layer.width, layer.height)};
+        _converter.convert_into(clip_frame, scaled.get(), 0, 0, layer.width, layer.height);
+
+        auto &still = *layer.still;
+        still.format = format;
+        still.width = layer.width;
+        still.height = layer.height;
+        still.opaque = !has_alpha((AVPixelFormat)clip_frame->format);
+        still.frame = scaled.share();
+
+        layer.frame = std::move(scaled);
+    }
+
+    void VideoComposer::convert_layer(Layer &layer, AVFrame *clip_frame)
+    {
+        // Scaled by swscale even when rotated, the warp only has to turn it
+        layer.frame = FrameRef{_converter.convert(clip_frame, layer.width, layer.height)};
     }
 
     bool VideoComposer::has_stream(AVMediaType frame_type)
@@ -225,7 +853,9 @@ namespace core
         if (clip.end_position() < _composition->start_position)
             return;
 
-        _sources.emplace(clip.id, clip.file);
+        _sources.emplace(std::piecewise_construct,
+            std::forward_as_tuple(clip.id),
+            std::forward_as_tuple(clip.file, _props.prefer_proxies));
     }
 
     void VideoComposer::add_track(Timeline::Track &track)
@@ -233,9 +863,6 @@ namespace core
         LOG_TRACE_L1(logger, "add track, id = {}", track.id);
 
         _tracks.emplace(track.id, track);
-
-        if (_frame_converters.find(track.id) == _frame_converters.end())
-            _frame_converters.emplace(track.id, ffmpeg::FrameConverter(AVPixelFormat::AV_PIX_FMT_RGB24));
     }
 
     void VideoComposer::rm_track(Timeline::TrackID track_id)
@@ -243,9 +870,6 @@ namespace core
         LOG_TRACE_L1(logger, "rm track, id = {}", track_id);
 
         _tracks.erase(track_id);
-
-        if (_frame_converters.find(track_id) != _frame_converters.end())
-            _frame_converters.erase(track_id);
     }
 
     void VideoComposer::rm_clip(Timeline::ClipID clip_id)
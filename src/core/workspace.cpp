@@ -7,6 +7,8 @@ namespace core
         _props(std::move(props)),
         _timeline(_props)
     {
+        ffmpeg::set_decode_thread_budget(_props.decode_threads);
+
         _timeline.track_modified_event.add_callback([this](auto track_id) {
             _force_preview_refresh = true;
         });
@@ -40,6 +42,8 @@ namespace core
 
     void Workspace::add_clip(core::MediaFile media_file)
     {
+        _proxy_manager.request(media_file);
+
         auto &active_track = _timeline.get_track(_active_track_id);
         active_track.add_clip(media_file, _cursor);
     }
@@ -1,5 +1,8 @@
 #include "ffmpeg/frame_converter.h"
+#include "ffmpeg/frame_pool.h"
+#include "ffmpeg/scaler_cache.h"
 #include "logging.h"
+#include <cassert>
 #include <stdexcept>
 
 static auto logger = logging::get_logger("FrameConverter");
@@ -13,44 +16,61 @@ namespace ffmpeg
 
     AVFrame *FrameConverter::convert(AVFrame *in_frame, int target_width, int target_height)
     {
-        if (target_width != _target_width || target_height != _target_height)
-        {
-            alloc_out_frame(target_width, target_height);
-        }
+        // Every call gets a frame of its own, so returned frames can be held
+        // onto while the next ones are converted
+        AVFrame *out_frame = get_frame_pool().get(_target_format, target_width, target_height);
 
-        _sws_ctx = sws_getCachedContext(
-            _sws_ctx,
-            in_frame->width, in_frame->height, (AVPixelFormat)in_frame->format,
-            _target_width, _target_height, _target_format,
-            _sws_flags, nullptr, nullptr, nullptr
-        );
+        const auto scaler = get_scaler(in_frame, target_width, target_height, _target_format);
 
-        if (int err = sws_scale_frame(_sws_ctx, _out_frame, in_frame); err <= 0)
+        if (int err = sws_scale_frame(scaler.get(), out_frame, in_frame); err <= 0)
         {
+            av_frame_free(&out_frame);
             throw std::runtime_error("sws_scale " + std::to_string(err));
         }
 
-        return av_frame_clone(_out_frame);
+        return out_frame;
     }
 
-    void FrameConverter::alloc_out_frame(int w, int h)
+    void FrameConverter::convert_into(AVFrame *in_frame, AVFrame *dst, int x, int y, int target_width, int target_height)
     {
-        if (_out_frame != nullptr)
+        const auto dst_format = (AVPixelFormat)dst->format;
+
+        assert(x >= 0 && y >= 0 && x + target_width <= dst->width && y + target_height <= dst->height);
+
+        const auto scaler = get_scaler(in_frame, target_width, target_height, dst_format);
+
+        const auto *desc = av_pix_fmt_desc_get(dst_format);
+
+        uint8_t *dst_data[AV_NUM_DATA_POINTERS]{};
+
+        // Offset each plane to the top left corner of the rect, accounting
+        // for chroma subsampling and the size of a pixel in that plane
+        for (int i = 0; i < desc->nb_components; i++)
         {
-            LOG_DEBUG(logger, "Freeing old frame, w = {}, h = {}", _out_frame->width, _out_frame->height);
-            av_frame_free(&_out_frame);
-        }
+            const auto &comp = desc->comp[i];
 
-        _out_frame = av_frame_alloc();
-        _out_frame->width = _target_width = w;
-        _out_frame->height = _target_height = h;
-        _out_frame->format = _target_format;
-        LOG_DEBUG(logger, "Allocating new frame, w = {}, h = {}", w, h);
+            if (dst_data[comp.plane])
+                continue;
 
-        if (av_frame_get_buffer(_out_frame, 0) != 0)
+            const bool chroma = (i == 1 || i == 2) && desc->nb_components > 2;
+            const int plane_x = chroma? (x >> desc->log2_chroma_w) : x;
+            const int plane_y = chroma? (y >> desc->log2_chroma_h) : y;
+
+            dst_data[comp.plane] = dst->data[comp.plane] + plane_y * dst->linesize[comp.plane] + plane_x * comp.step;
+        }
+
+        if (int err = sws_scale(scaler.get(), in_frame->data, in_frame->linesize, 0, in_frame->height, dst_data, dst->linesize); err <= 0)
         {
-            throw std::runtime_error("av_frame_get_buffer");
+            throw std::runtime_error("sws_scale " + std::to_string(err));
         }
     }
-}
 
+    ScalerCache::Lease FrameConverter::get_scaler(AVFrame *in_frame, int target_width, int target_height, AVPixelFormat target_format) const
+    {
+        return get_scaler_cache().acquire({
+            in_frame->width, in_frame->height, (AVPixelFormat)in_frame->format,
+            target_width, target_height, target_format,
+            _sws_flags,
+        });
+    }
+}
@@ -0,0 +1,139 @@
+#include "ffmpeg/frame_pool.h"
+#include "logging.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+#include <algorithm>
+#include <stdexcept>
+
+static auto logger = logging::get_logger("FramePool");
+
+namespace ffmpeg
+{
+    // Enough for the widest SIMD loads of swscale and the decoders
+    static constexpr int buffer_align = 64;
+
+    // Readers may overshoot the last row a little
+    static constexpr size_t buffer_padding = AV_INPUT_BUFFER_PADDING_SIZE;
+
+    static constexpr size_t max_frame_pools = 32;
+
+    FramePool::FramePool(size_t max_pools):
+        _max_pools(max_pools)
+    {
+    }
+
+    FramePool::~FramePool()
+    {
+        // Buffers still in use are freed once they're released
+        for (auto &pool : _pools)
+            av_buffer_pool_uninit(&pool.pool);
+    }
+
+    AVFrame *FramePool::get(AVPixelFormat format, int width, int height)
+    {
+        AVFrame *frame = av_frame_alloc();
+        frame->format = format;
+        frame->width = width;
+        frame->height = height;
+
+        if (!get_buffer(frame, width, height))
+        {
+            av_frame_free(&frame);
+            throw std::runtime_error("FramePool::get_buffer");
+        }
+
+        return frame;
+    }
+
+    bool FramePool::get_buffer(AVFrame *frame, int alloc_width, int alloc_height, int linesize_align)
+    {
+        const auto format = (AVPixelFormat)frame->format;
+
+        if (linesize_align > buffer_align)
+            return false;
+
+        const int size = av_image_get_buffer_size(format, alloc_width, alloc_height, buffer_align);
+
+        if (size < 0)
+            return false;
+
+        AVBufferRef *buf = get_pooled_buffer(format, alloc_width, alloc_height, size + buffer_padding);
+
+        if (!buf)
+            return false;
+
+        // All planes live in the one buffer, with aligned linesizes
+        if (av_image_fill_arrays(frame->data, frame->linesize, buf->data, format, alloc_width, alloc_height, buffer_align) < 0)
+        {
+            av_buffer_unref(&buf);
+            return false;
+        }
+
+        frame->buf[0] = buf;
+        frame->extended_data = frame->data;
+
+        return true;
+    }
+
+    AVBufferRef *FramePool::get_pooled_buffer(AVPixelFormat format, int width, int height, size_t size)
+    {
+        std::lock_guard lock{_mutex};
+
+        auto it = std::find_if(_pools.begin(), _pools.end(), [&](const Pool &pool) {
+            return pool.format == format && pool.width == width && pool.height == height && pool.size == size;
+        });
+
+        if (it != _pools.end())
+        {
+            _pools.splice(_pools.begin(), _pools, it);
+        }
+        else
+        {
+            LOG_DEBUG(logger, "New pool, format = {}, w = {}, h = {}, size = {}", av_get_pix_fmt_name(format), width, height, size);
+
+            _pools.push_front({format, width, height, size, av_buffer_pool_init(size, nullptr)});
+
+            if (_pools.size() > _max_pools)
+            {
+                av_buffer_pool_uninit(&_pools.back().pool);
+                _pools.pop_back();
+            }
+        }
+
+        return av_buffer_pool_get(_pools.front().pool);
+    }
+
+    FramePool &get_frame_pool()
+    {
+        static FramePool pool{max_frame_pools};
+
+        return pool;
+    }
+
+    int get_pooled_buffer2(AVCodecContext *codec_ctx, AVFrame *frame, int flags)
+    {
+        // Audio and hardware frames are left to the default allocator
+        if (codec_ctx->codec_type != AVMEDIA_TYPE_VIDEO || codec_ctx->hw_frames_ctx || !(codec_ctx->codec->capabilities & AV_CODEC_CAP_DR1))
+            return avcodec_default_get_buffer2(codec_ctx, frame, flags);
+
+        // Decoders write past the visible size, up to whole macroblocks
+        int width = frame->width;
+        int height = frame->height;
+        int linesize_align[AV_NUM_DATA_POINTERS];
+
+        avcodec_align_dimensions2(codec_ctx, &width, &height, linesize_align);
+
+        int max_linesize_align = 0;
+
+        for (int align : linesize_align)
+            max_linesize_align = std::max(max_linesize_align, align);
+
+        if (!get_frame_pool().get_buffer(frame, width, height, max_linesize_align))
+            return avcodec_default_get_buffer2(codec_ctx, frame, flags);
+
+        return 0;
+    }
+}
@@ -2,6 +2,9 @@
 
 #include "ffmpeg/headers.h"
 #include "fmt/base.h"
+#include "logging.h"
+
+static auto logger = logging::get_logger("io_ffmpeg");
 
 namespace ffmpeg
 {
@@ -23,6 +26,80 @@ namespace ffmpeg
         return stream->duration <= 0;
     }
 
+    static int interrupt_keyframe_scan(void *opaque)
+    {
+        const auto *index = static_cast<const core::KeyframeIndex*>(opaque);
+
+        return index->is_cancelled();
+    }
+
+    // Demux the whole file once, without decoding, and record
+    // the timestamps of all video keyframes
+    static void scan_keyframes(const std::string &path, core::KeyframeIndex &index)
+    {
+        auto *format_ctx = avformat_alloc_context();
+        format_ctx->interrupt_callback = {interrupt_keyframe_scan, &index};
+
+        if (int err = avformat_open_input(&format_ctx, path.c_str(), nullptr, nullptr); err != 0)
+        {
+            LOG_WARNING(logger, "Cannot open file for keyframe scan, path = {}", path);
+            return;
+        }
+
+        avformat_find_stream_info(format_ctx, nullptr);
+
+        const int video_stream = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+
+        if (video_stream < 0)
+        {
+            avformat_close_input(&format_ctx);
+            return;
+        }
+
+        // Let the demuxer skip over other streams
+        for (size_t i = 0; i < format_ctx->nb_streams; i++)
+        {
+            if ((int)i != video_stream)
+                format_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+
+        const auto tb = format_ctx->streams[video_stream]->time_base;
+        auto *packet = av_packet_alloc();
+
+        while (!index.is_cancelled() && av_read_frame(format_ctx, packet) >= 0)
+        {
+            const bool has_ts = packet->pts != AV_NOPTS_VALUE || packet->dts != AV_NOPTS_VALUE;
+
+            if (packet->stream_index == video_stream && (packet->flags & AV_PKT_FLAG_KEY) && has_ts)
+            {
+                const auto pts = (packet->pts != AV_NOPTS_VALUE)? packet->pts : packet->dts;
+
+                // Same units as the frame pts returned by MediaSource
+                index.add(core::timestamp{core::timestamp(1s).count() * pts / tb.den});
+            }
+
+            av_packet_unref(packet);
+        }
+
+        LOG_DEBUG(logger, "Keyframe scan done, path = {}, keyframes = {}", path, index.size());
+
+        av_packet_free(&packet);
+        avformat_close_input(&format_ctx);
+    }
+
+    static bool stream_has_alpha(const AVStream *stream)
+    {
+        const auto *desc = av_pix_fmt_desc_get((AVPixelFormat)stream->codecpar->format);
+
+        if (desc && (desc->flags & AV_PIX_FMT_FLAG_ALPHA))
+            return true;
+
+        // VP8/VP9 in WebM carry alpha in side data, the stream itself looks opaque
+        const auto *alpha_mode = av_dict_get(stream->metadata, "alpha_mode", nullptr, 0);
+
+        return alpha_mode && std::string{alpha_mode->value} == "1";
+    }
+
     namespace io
     {
         core::MediaFile open_file(const std::string &path)
@@ -42,6 +119,7 @@ namespace ffmpeg
                 {
                     file.width = stream->codecpar->width;
                     file.height = stream->codecpar->height;
+                    file.has_alpha = stream_has_alpha(stream);
                 }
             }
 
@@ -53,6 +131,11 @@ namespace ffmpeg
             else
             {
                 file.duration = core::custom_duration<1, AV_TIME_BASE>(format_ctx->duration);
+
+                file.keyframes = std::make_shared<core::KeyframeIndex>();
+                file.keyframes->build_async([path](core::KeyframeIndex &index) {
+                    scan_keyframes(path, index);
+                });
             }
 
             avformat_close_input(&format_ctx);
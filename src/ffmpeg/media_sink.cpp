@@ -135,28 +135,44 @@ namespace ffmpeg
             return _path;
         }
 
-        void write_frame(AVMediaType frame_type, AVFrame *frame) override
+        AVPixelFormat get_video_format() override
+        {
+            const auto it = _stream_encoders.find(AVMEDIA_TYPE_VIDEO);
+
+            return (it != _stream_encoders.end())? it->second->pix_fmt : AV_PIX_FMT_NONE;
+        }
+
+        void write_frame(AVMediaType frame_type, const core::FrameRef &in_frame) override
         {
             AVStream *stream = (frame_type == AVMEDIA_TYPE_VIDEO)
                 ? _video_stream
                 : _audio_stream;
 
             auto *encoder = _stream_encoders.at(frame_type);
-            bool must_free{false};
+
+            // Our own reference, the caller may keep using in_frame meanwhile
+            core::FrameRef frame;
 
             if (frame_type == AVMEDIA_TYPE_VIDEO)
             {
-                LOG_INFO(logger, "write_frame, pts = {}", frame->pts);
+                LOG_INFO(logger, "write_frame, pts = {}", in_frame->pts);
+
+                // Frames composed in the encoder format go in as they are
+                if (in_frame->format == encoder->pix_fmt && in_frame->width == encoder->width && in_frame->height == encoder->height)
+                    frame = in_frame.share();
+                else
+                    frame = core::FrameRef{_frame_converter.convert(in_frame.get(), encoder->width, encoder->height)};
 
-                frame = _frame_converter.convert(frame, frame->width, frame->height);
                 frame->pts = encoder->frame_num;
 
                 LOG_INFO(logger, "convert, pts = {}", frame->pts);
-
-                must_free = true;
+            }
+            else
+            {
+                frame = in_frame.share();
             }
 
-            if (avcodec_send_frame(encoder, frame) != 0)
+            if (avcodec_send_frame(encoder, frame.get()) != 0)
             {
                 LOG_ERROR(logger, "Failed to send frame to encoder");
                 throw std::runtime_error("avcodec_send_frame");
@@ -175,11 +191,6 @@ namespace ffmpeg
                     throw std::runtime_error("av_interleaved_write_frame");
                 }
             }
-
-            if (must_free)
-            {
-                av_frame_unref(frame);
-            }
         }
 
         ~MediaSink()
@@ -1,4 +1,5 @@
 #include "ffmpeg/media_source.h"
+#include "ffmpeg/frame_pool.h"
 #include "core/media_source.h"
 
 #include "fmt/format.h"
@@ -6,8 +7,15 @@
 #include <stdexcept>
 #include <string>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <memory>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
 
 #include "logging.h"
 
@@ -19,15 +27,123 @@ namespace ffmpeg
 
 #define make_errstr(err) av_make_error_string(err_buffer, sizeof err_buffer, err)
 
+    // See set_decode_thread_budget
+    static std::atomic<int> decode_thread_budget{0};
+
+    // Threads granted to the decoders open right now
+    static std::mutex decode_threads_mutex;
+    static int allocated_decode_threads{0};
+
+    // A thread per this many pixels, so small videos don't pay for
+    // synchronizing threads which would mostly idle
+    static constexpr int pixels_per_thread = 512 * 1024;
+    static constexpr int max_decoder_threads = 16;
+
+    // Frame threading delays output by a frame per thread, which only pays
+    // off for inter coded video this large
+    static constexpr int frame_threading_min_pixels = 1920 * 1080;
+
+    // Take up to wanted threads out of what's left of the budget, a decoder
+    // always gets one even once it's used up
+    static int acquire_decode_threads(int wanted)
+    {
+        std::lock_guard lock{decode_threads_mutex};
+
+        int budget = decode_thread_budget;
+
+        if (budget <= 0)
+            budget = std::max(1, (int)std::thread::hardware_concurrency());
+
+        const int granted = std::clamp(wanted, 1, std::max(1, budget - allocated_decode_threads));
+        allocated_decode_threads += granted;
+
+        return granted;
+    }
+
+    static void release_decode_threads(int threads)
+    {
+        std::lock_guard lock{decode_threads_mutex};
+
+        allocated_decode_threads -= threads;
+    }
+
+    // Returns the threads taken from the budget, to be given back with release_decode_threads
+    static int configure_threads(AVCodecContext *codec_ctx, const AVCodec *codec)
+    {
+        codec_ctx->thread_count = 1;
+
+        if (codec_ctx->codec_type != AVMEDIA_TYPE_VIDEO)
+            return 0;
+
+        const int pixels = codec_ctx->width * codec_ctx->height;
+
+        const auto *desc = avcodec_descriptor_get(codec_ctx->codec_id);
+        const bool intra_only = desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY);
+
+        const bool can_frame = codec->capabilities & AV_CODEC_CAP_FRAME_THREADS;
+        const bool can_slice = codec->capabilities & AV_CODEC_CAP_SLICE_THREADS;
+        const bool want_frame = !intra_only && pixels >= frame_threading_min_pixels;
+
+        if (can_frame && (want_frame || !can_slice))
+            codec_ctx->thread_type = FF_THREAD_FRAME;
+        else if (can_slice)
+            codec_ctx->thread_type = FF_THREAD_SLICE;
+        else
+            return 0;
+
+        // Decoders opened while others hold most of the budget get what's left
+        const int threads = acquire_decode_threads(std::clamp(pixels / pixels_per_thread, 1, max_decoder_threads));
+
+        codec_ctx->thread_count = threads;
+
+        LOG_DEBUG(logger, "Decode threads, codec = {}, size = {}x{}, threads = {}, type = {}",
+            codec->name, codec_ctx->width, codec_ctx->height, threads,
+            (codec_ctx->thread_type == FF_THREAD_FRAME)? "frame" : "slice");
+
+        return threads;
+    }
+
+    void set_decode_thread_budget(int threads)
+    {
+        LOG_INFO(logger, "Set decode thread budget, threads = {}", threads);
+
+        decode_thread_budget = threads;
+    }
+
+    // Packets read ahead per stream, the demuxer waits once every
+    // active stream has this many queued
+    static constexpr size_t max_queued_packets = 64;
+
+    // A stream this far behind is taken as no longer being read, its packets
+    // are dropped until it's asked for again, instead of piling up
+    static constexpr size_t max_undrained_packets = 16 * max_queued_packets;
+
+    // Network and live inputs may have nothing to read for a moment
+    static constexpr auto read_retry_delay = std::chrono::milliseconds{10};
+
     struct Stream
     {
         AVMediaType type;
+        AVRational time_base;
         const AVCodec *codec;
         AVCodecContext *codec_ctx;
-        std::queue<AVFrame*> frame_queue;
+
+        // Filled by the demux thread, only once next_frame asked for this stream
+        std::deque<AVPacket*> packets;
+        bool active{false};
+
+        // Sent the flush packet after EOF, frames held back by the decoder come out now
+        bool draining{false};
+
+        // Packets were dropped since it was last read, the decoder state is stale
+        bool overrun{false};
+
+        // Taken from the decode thread budget
+        int decode_threads{0};
 
         Stream(AVStream *stream):
-            type(stream->codecpar->codec_type)
+            type(stream->codecpar->codec_type),
+            time_base(stream->time_base)
         {
             const auto &codecpar = stream->codecpar;
 
@@ -42,51 +158,63 @@ namespace ffmpeg
             LOG_DEBUG(logger, "Using codec {} ({})", codec->name, codec->long_name);
 
             avcodec_parameters_to_context(codec_ctx, codecpar);
+            decode_threads = configure_threads(codec_ctx, codec);
+
+            // Let decoders reuse frame buffers after one another, scrubbing
+            // through clips recreates them often
+            codec_ctx->get_buffer2 = get_pooled_buffer2;
 
             if (int err = avcodec_open2(codec_ctx, codec, nullptr) != 0)
             {
                 LOG_CRITICAL(logger, "Cannot open codec, {}", make_errstr(err));
 
+                avcodec_free_context(&codec_ctx);
+                release_decode_threads(decode_threads);
+
                 throw fmt::system_error(err, "avcodec_open2");
             }
         }
 
         ~Stream()
         {
-            while (!frame_queue.empty())
-            {
-                auto *frame = frame_queue.front();
-                av_frame_free(&frame);
-
-                frame_queue.pop();
-            }
-
+            clear_packets();
             avcodec_free_context(&codec_ctx);
+            release_decode_threads(decode_threads);
         }
 
-        AVFrame* pop_frame()
+        void clear_packets()
         {
-            if (frame_queue.empty())
-                return nullptr;
+            for (auto *packet : packets)
+                av_packet_free(&packet);
 
-            auto *frame = frame_queue.back();
-            frame_queue.pop();
+            packets.clear();
+        }
 
-            return frame;
+        // Drop decoder state, it's stale after a seek
+        void flush()
+        {
+            avcodec_flush_buffers(codec_ctx);
+            draining = false;
         }
     };
 
     using StreamPtr = std::unique_ptr<Stream>;
 
+    // Reading packets happens on a separate demux thread, so decoding
+    // doesn't stall on slow storage and I/O overlaps with decoding.
+    // Seeks are carried out by the demux thread too, in between reads.
     class MediaSource : public core::MediaSource
     {
     public:
         MediaSource(core::MediaFile file):
             _file(std::move(file)),
-            _format_ctx(nullptr)
+            _format_ctx(avformat_alloc_context())
         {
             LOG_DEBUG(logger, "Opening {}", _file.path);
 
+            // Lets closing abort a read stuck on the network
+            _format_ctx->interrupt_callback = {interrupt_demux, this};
+
             int err = avformat_open_input(&_format_ctx, _file.path.c_str(), nullptr, nullptr);
 
             if (err != 0)
@@ -97,10 +225,14 @@ namespace ffmpeg
 
             avformat_find_stream_info(_format_ctx, nullptr);
 
-            _streams.reserve(_format_ctx->nb_streams);
+            // Indexed the same as the format context streams, null if it can't be decoded
+            _streams.resize(_format_ctx->nb_streams);
 
             for (size_t i = 0; i < _format_ctx->nb_streams; i++)
             {
+                // Nothing is read until the stream is asked for
+                _format_ctx->streams[i]->discard = AVDISCARD_ALL;
+
                 try
                 {
                     auto stream = std::make_unique<Stream>(_format_ctx->streams[i]);
@@ -117,7 +249,7 @@ namespace ffmpeg
                         _video_stream = i;
                     }
 
-                    _streams.push_back(std::move(stream));
+                    _streams[i] = std::move(stream);
                 }
                 catch (const std::exception &e)
                 {
@@ -125,15 +257,23 @@ namespace ffmpeg
                 }
             }
 
-            _packet = av_packet_alloc();
+            _demux_thread = std::thread{[this] { run_demux(); }};
         }
 
         ~MediaSource() override
         {
             LOG_DEBUG(logger, "Closing {}", _file.path);
 
+            {
+                std::lock_guard lock{_demux_mutex};
+                _demux_stop = true;
+            }
+
+            _demux_cv.notify_all();
+            _demux_thread.join();
+
+            _streams.clear();
             avformat_close_input(&_format_ctx);
-            av_packet_free(&_packet);
         }
 
         std::string get_name() override
@@ -147,21 +287,15 @@ namespace ffmpeg
 
             LOG_DEBUG(logger, "Seek to {}s, tb_offset = {}", position / 1.0s, tb_offset);
 
-            int err = avformat_seek_file(_format_ctx, -1, 0, tb_offset, tb_offset, 0);
-
-            return err >= 0;
+            return request_seek({tb_offset, false});
         }
 
         bool seek(int64_t byte_offset) override
         {
-            //avio_tell(_format_ctx);
-
-            int err = av_seek_frame(_format_ctx, -1, byte_offset, AVSEEK_FLAG_BYTE);
-
-            return err >= 0;
+            return request_seek({byte_offset, true});
         }
 
-        AVFrame* next_frame(AVMediaType frame_type) override
+        core::FrameRef next_frame(AVMediaType frame_type) override
         {
             Stream* wanted_stream;
 
@@ -172,64 +306,58 @@ namespace ffmpeg
             else
                 throw std::runtime_error("Unsupported media type");
 
-            // Maybe we already have it?
-            if (auto *frame = wanted_stream->pop_frame())
-                return frame;
-
-            AVFrame *frame = av_frame_alloc();
+            core::FrameRef frame{av_frame_alloc()};
 
             LOG_TRACE_L3(logger, "Begin next_frame");
 
             while (1)
             {
-                int err = av_read_frame(_format_ctx, _packet);
+                int err = avcodec_receive_frame(wanted_stream->codec_ctx, frame.get());
 
-                if (err == AVERROR_EOF)
+                if (err == 0)
                 {
-                    LOG_DEBUG(logger, "End of file {}", _file.path);
-                    break;
-                }
+                    // Rewrite pts into timestamp units
+                    const auto original_pts = frame->pts;
+                    frame->pts = (core::timestamp(1s).count() * frame->pts / wanted_stream->time_base.den);
 
-                LOG_TRACE_L1(logger, "Read packet, pts = {}, size = {}", _packet->pts, _packet->size);
+                    LOG_TRACE_L1(logger, "Receive frame, original_pts = {}, new_pts = {}", original_pts, frame->pts);
+                    LOG_TRACE_L3(logger, "End next_frame");
 
-                auto *stream = _streams[_packet->stream_index].get();
-                const auto tb = _format_ctx->streams[_packet->stream_index]->time_base;
+                    return frame;
+                }
 
-                avcodec_send_packet(stream->codec_ctx, _packet);
-                av_packet_unref(_packet);
+                if (err == AVERROR_EOF)
+                    break;
 
-                err = avcodec_receive_frame(stream->codec_ctx, frame);
+                if (err != AVERROR(EAGAIN))
+                    throw std::runtime_error("avcodec_receive_frame");
 
-                if (err == 0)
-                {
-                    // Rewrite pts into timestamp units
-                    const auto original_pts = frame->pts;
-                    frame->pts = (core::timestamp(1s).count() * frame->pts / tb.den);
+                // Decoder wants more input
+                AVPacket *packet = pop_packet(wanted_stream);
 
-                    if (stream == wanted_stream)
-                    {
-                        LOG_TRACE_L1(logger, "Receive frame, original_pts = {}, new_pts = {}", original_pts, frame->pts);
-                        LOG_TRACE_L3(logger, "End next_frame");
-                        return frame;
-                    }
-                    else
-                    {
-                        stream->frame_queue.push(frame);
-                        frame = av_frame_alloc();
-                    }
-                }
-                else if (err != AVERROR(EAGAIN))
+                if (!packet)
                 {
-                    throw std::runtime_error("avcodec_receive_frame");
+                    if (wanted_stream->draining)
+                        break;
+
+                    LOG_DEBUG(logger, "End of file {}", _file.path);
+
+                    // Threaded decoders still hold the last few frames
+                    avcodec_send_packet(wanted_stream->codec_ctx, nullptr);
+                    wanted_stream->draining = true;
+
+                    continue;
                 }
+
+                LOG_TRACE_L1(logger, "Decode packet, pts = {}, size = {}", packet->pts, packet->size);
+
+                avcodec_send_packet(wanted_stream->codec_ctx, packet);
+                av_packet_free(&packet);
             }
 
             LOG_TRACE_L3(logger, "End next_frame");
 
-            av_packet_unref(_packet);
-            av_frame_free(&frame);
-
-            return nullptr;
+            return {};
         }
 
         bool has_stream(AVMediaType frame_type) override
@@ -247,13 +375,210 @@ namespace ffmpeg
         }
 
     private:
+        struct SeekRequest
+        {
+            int64_t offset;
+            bool is_byte_offset;
+        };
+
         core::MediaFile _file;
         AVFormatContext *_format_ctx;
-        AVPacket *_packet;
         std::vector<StreamPtr> _streams;
         int _video_stream{-1};
         int _audio_stream{-1};
 
+        // Demux thread state, packet queues of the streams are guarded by the mutex too
+        std::thread _demux_thread;
+        std::mutex _demux_mutex;
+        std::condition_variable _demux_cv;
+        std::atomic<bool> _demux_stop{false};
+        std::optional<SeekRequest> _seek_request;
+        bool _seek_result{false};
+        bool _eof{false};
+
+        static int interrupt_demux(void *opaque)
+        {
+            return static_cast<const MediaSource*>(opaque)->_demux_stop;
+        }
+
+        void run_demux()
+        {
+            AVPacket *packet = av_packet_alloc();
+
+            std::unique_lock lock{_demux_mutex};
+
+            while (1)
+            {
+                _demux_cv.wait(lock, [this] {
+                    return _demux_stop || _seek_request.has_value() || (!_eof && wants_packets());
+                });
+
+                if (_demux_stop)
+                    break;
+
+                if (_seek_request.has_value())
+                {
+                    const auto request = *_seek_request;
+
+                    lock.unlock();
+
+                    const int err = request.is_byte_offset
+                        ? av_seek_frame(_format_ctx, -1, request.offset, AVSEEK_FLAG_BYTE)
+                        : avformat_seek_file(_format_ctx, -1, 0, request.offset, request.offset, 0);
+
+                    lock.lock();
+
+                    for (auto &stream : _streams)
+                    {
+                        if (stream)
+                            stream->clear_packets();
+                    }
+
+                    _eof = false;
+                    _seek_result = (err >= 0);
+                    _seek_request.reset();
+                    _demux_cv.notify_all();
+
+                    continue;
+                }
+
+                // Only this thread reads, so changing what's discarded is safe here
+                for (size_t i = 0; i < _streams.size(); i++)
+                {
+                    const bool active = _streams[i] && _streams[i]->active;
+                    _format_ctx->streams[i]->discard = active? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+                }
+
+                lock.unlock();
+                const int err = av_read_frame(_format_ctx, packet);
+                lock.lock();
+
+                if (err == AVERROR(EAGAIN))
+                {
+                    _demux_cv.wait_for(lock, read_retry_delay, [this] {
+                        return _demux_stop || _seek_request.has_value();
+                    });
+
+                    continue;
+                }
+
+                if (err < 0)
+                {
+                    if (err != AVERROR_EOF && !_demux_stop)
+                        LOG_WARNING(logger, "Read failed, path = {}, err = {}", _file.path, make_errstr(err));
+
+                    _eof = true;
+                    _demux_cv.notify_all();
+
+                    continue;
+                }
+
+                // Streams can also show up mid-file, those are never decoded
+                auto *stream = (packet->stream_index < (int)_streams.size())
+                    ? _streams[packet->stream_index].get()
+                    : nullptr;
+
+                // Read before a seek request came in, it belongs to the old position
+                if (_seek_request.has_value() || !stream || !stream->active)
+                {
+                    av_packet_unref(packet);
+                    continue;
+                }
+
+                // Activated once but not read from since, while other streams are
+                if (stream->packets.size() >= max_undrained_packets)
+                {
+                    LOG_WARNING(logger, "Stream not read, dropping its packets, path = {}, stream = {}", _file.path, packet->stream_index);
+
+                    stream->clear_packets();
+                    stream->active = false;
+                    stream->overrun = true;
+
+                    av_packet_unref(packet);
+                    continue;
+                }
+
+                AVPacket *queued = av_packet_alloc();
+                av_packet_move_ref(queued, packet);
+
+                stream->packets.push_back(queued);
+                _demux_cv.notify_all();
+            }
+
+            av_packet_free(&packet);
+        }
+
+        // Keep reading while some active stream is short of packets, streams nobody
+        // consumes are never waited for, so they can't hold up the others
+        bool wants_packets() const
+        {
+            return std::any_of(_streams.begin(), _streams.end(), [](const auto &stream) {
+                return stream && stream->active && stream->packets.size() < max_queued_packets;
+            });
+        }
+
+        // Next packet of the stream, nullptr at EOF
+        AVPacket *pop_packet(Stream *stream)
+        {
+            std::unique_lock lock{_demux_mutex};
+
+            if (!stream->active)
+            {
+                stream->active = true;
+                _demux_cv.notify_all();
+            }
+
+            // Decoding picks up from wherever the demuxer is now
+            if (stream->overrun)
+            {
+                stream->overrun = false;
+                stream->flush();
+            }
+
+            _demux_cv.wait(lock, [this, stream] { return !stream->packets.empty() || _eof; });
+
+            if (stream->packets.empty())
+                return nullptr;
+
+            auto *packet = stream->packets.front();
+            stream->packets.pop_front();
+
+            // Made room in the queue
+            _demux_cv.notify_all();
+
+            return packet;
+        }
+
+        bool request_seek(SeekRequest request)
+        {
+            bool result;
+
+            {
+                std::unique_lock lock{_demux_mutex};
+
+                _seek_request = request;
+                _demux_cv.notify_all();
+
+                _demux_cv.wait(lock, [this] { return !_seek_request.has_value(); });
+
+                result = _seek_result;
+            }
+
+            if (result)
+                flush_streams();
+
+            return result;
+        }
+
+        void flush_streams()
+        {
+            for (auto &stream : _streams)
+            {
+                if (stream)
+                    stream->flush();
+            }
+        }
+
         Stream* get_audio_stream() const noexcept
         {
             return _streams[_audio_stream].get();
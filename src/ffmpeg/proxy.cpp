@@ -0,0 +1,186 @@
+#include "ffmpeg/proxy.h"
+
+#include "core/frame_ref.h"
+#include "ffmpeg/frame_converter.h"
+#include "ffmpeg/headers.h"
+#include "ffmpeg/media_source.h"
+#include "logging.h"
+
+#include <stdexcept>
+
+static auto logger = logging::get_logger("Proxy_ffmpeg");
+
+namespace ffmpeg
+{
+    // MJPEG quantizer, lower is better
+    static constexpr int proxy_qscale = 4;
+
+    class ProxyWriter
+    {
+    public:
+        ProxyWriter(const std::string &path, int width, int height):
+            _path(path),
+            _pkt(av_packet_alloc())
+        {
+            // The destructor won't run if we throw, free what's set up so far
+            try
+            {
+                open(width, height);
+            }
+            catch (...)
+            {
+                close();
+                throw;
+            }
+        }
+
+        ~ProxyWriter()
+        {
+            close();
+        }
+
+        void write_frame(AVFrame *frame)
+        {
+            if (avcodec_send_frame(_codec_ctx, frame) != 0)
+            {
+                throw std::runtime_error("avcodec_send_frame");
+            }
+
+            write_packets();
+        }
+
+        void finish()
+        {
+            avcodec_send_frame(_codec_ctx, nullptr);
+            write_packets();
+
+            av_write_trailer(_format_ctx);
+        }
+
+    private:
+        std::string _path;
+        AVFormatContext *_format_ctx{nullptr};
+        AVCodecContext *_codec_ctx{nullptr};
+        AVStream *_stream{nullptr};
+        AVPacket *_pkt;
+
+        void open(int width, int height)
+        {
+            if (avformat_alloc_output_context2(&_format_ctx, nullptr, "matroska", _path.c_str()) < 0)
+            {
+                throw std::runtime_error("avformat_alloc_output_context2");
+            }
+
+            const auto *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+
+            if (codec == nullptr)
+            {
+                throw std::runtime_error("Cannot find MJPEG encoder");
+            }
+
+            _codec_ctx = avcodec_alloc_context3(codec);
+            _codec_ctx->width = width;
+            _codec_ctx->height = height;
+            _codec_ctx->pix_fmt = AV_PIX_FMT_YUVJ420P;
+            _codec_ctx->time_base = AVRational{1, (int)core::timestamp(1s).count()};
+            _codec_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+            _codec_ctx->global_quality = FF_QP2LAMBDA * proxy_qscale;
+
+            if (_format_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+                _codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+            if (avcodec_open2(_codec_ctx, codec, nullptr) != 0)
+            {
+                throw std::runtime_error("avcodec_open2");
+            }
+
+            _stream = avformat_new_stream(_format_ctx, nullptr);
+            _stream->time_base = _codec_ctx->time_base;
+            avcodec_parameters_from_context(_stream->codecpar, _codec_ctx);
+
+            if (avio_open(&_format_ctx->pb, _path.c_str(), AVIO_FLAG_WRITE) < 0)
+            {
+                throw std::runtime_error("Cannot open avio");
+            }
+
+            if (avformat_write_header(_format_ctx, nullptr) < 0)
+            {
+                throw std::runtime_error("Failed to write header");
+            }
+        }
+
+        void close()
+        {
+            if (_format_ctx && _format_ctx->pb)
+                avio_closep(&_format_ctx->pb);
+
+            avcodec_free_context(&_codec_ctx);
+            avformat_free_context(_format_ctx);
+            _format_ctx = nullptr;
+            av_packet_free(&_pkt);
+        }
+
+        void write_packets()
+        {
+            while (avcodec_receive_packet(_codec_ctx, _pkt) == 0)
+            {
+                // Round up, so that proxy frames never appear earlier than the original ones
+                constexpr auto rounding = (AVRounding)(AV_ROUND_UP | AV_ROUND_PASS_MINMAX);
+
+                _pkt->pts = av_rescale_q_rnd(_pkt->pts, _codec_ctx->time_base, _stream->time_base, rounding);
+                _pkt->dts = av_rescale_q_rnd(_pkt->dts, _codec_ctx->time_base, _stream->time_base, rounding);
+                _pkt->duration = av_rescale_q(_pkt->duration, _codec_ctx->time_base, _stream->time_base);
+                _pkt->stream_index = _stream->index;
+
+                if (av_interleaved_write_frame(_format_ctx, _pkt) != 0)
+                {
+                    throw std::runtime_error("av_interleaved_write_frame");
+                }
+            }
+        }
+    };
+
+    bool transcode_proxy(const core::MediaFile &file, const std::string &out_path, int height, const ProxyProgressCallback &progress)
+    {
+        auto source = open_media_source(file);
+
+        if (!source || !source->has_stream(AVMEDIA_TYPE_VIDEO))
+        {
+            throw std::runtime_error("Cannot open video of " + file.path);
+        }
+
+        // Keep aspect ratio, encoders want even dimensions
+        const int width = (int)((int64_t)file.width * height / file.height) & ~1;
+
+        LOG_INFO(logger, "Transcoding proxy, path = {}, size = {}x{}", file.path, width, height);
+
+        ProxyWriter writer{out_path, width, height};
+        FrameConverter converter{AV_PIX_FMT_YUVJ420P};
+
+        while (auto frame = source->next_frame(AVMEDIA_TYPE_VIDEO))
+        {
+            const auto pts = frame->pts;
+
+            // Freed even if writing throws
+            core::FrameRef proxy_frame{converter.convert(frame.get(), width, height)};
+            proxy_frame->pts = pts;
+            frame.reset();
+
+            writer.write_frame(proxy_frame.get());
+
+            const float done = (file.duration > 0s)? core::timestamp{pts} / file.duration : 0.0f;
+
+            if (!progress(done))
+            {
+                LOG_INFO(logger, "Proxy cancelled, path = {}", file.path);
+                return false;
+            }
+        }
+
+        writer.finish();
+
+        LOG_INFO(logger, "Proxy done, path = {}", out_path);
+
+        return true;
+    }
+}
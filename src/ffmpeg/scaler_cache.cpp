@@ -0,0 +1,115 @@
+#include "ffmpeg/scaler_cache.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static auto logger = logging::get_logger("ScalerCache");
+
+namespace ffmpeg
+{
+    // Contexts are a few MB each at most, this covers a couple of clips
+    // per track on busy timelines
+    static constexpr size_t max_idle_scalers = 64;
+
+    ScalerCache::ScalerCache(size_t max_idle):
+        _max_idle(max_idle)
+    {
+    }
+
+    ScalerCache::~ScalerCache()
+    {
+        // Leased contexts can't outlive the cache, it's never destroyed before exit
+        for (auto &entry : _entries)
+        {
+            for (auto *ctx : entry.idle)
+                sws_freeContext(ctx);
+        }
+    }
+
+    ScalerCache::Lease ScalerCache::acquire(const Key &key)
+    {
+        {
+            std::lock_guard lock{_mutex};
+
+            const auto it = std::find_if(_entries.begin(), _entries.end(), [&key](const Entry &entry) {
+                return entry.key == key;
+            });
+
+            if (it != _entries.end())
+            {
+                // Mark as most recently used
+                _entries.splice(_entries.begin(), _entries, it);
+
+                if (!it->idle.empty())
+                {
+                    auto *ctx = it->idle.back();
+                    it->idle.pop_back();
+                    --_num_idle;
+
+                    return Lease{*this, key, ctx};
+                }
+            }
+        }
+
+        LOG_DEBUG(logger, "Create scaler, {}x{} {} -> {}x{} {}",
+                key.src_width, key.src_height, av_get_pix_fmt_name(key.src_format),
+                key.dst_width, key.dst_height, av_get_pix_fmt_name(key.dst_format));
+
+        // Building the filters is the slow part, don't hold up other threads meanwhile
+        auto *ctx = sws_getContext(
+            key.src_width, key.src_height, key.src_format,
+            key.dst_width, key.dst_height, key.dst_format,
+            key.flags, nullptr, nullptr, nullptr
+        );
+
+        if (!ctx)
+            throw std::runtime_error("sws_getContext");
+
+        return Lease{*this, key, ctx};
+    }
+
+    void ScalerCache::release(const Key &key, SwsContext *ctx)
+    {
+        std::lock_guard lock{_mutex};
+
+        auto it = std::find_if(_entries.begin(), _entries.end(), [&key](const Entry &entry) {
+            return entry.key == key;
+        });
+
+        if (it == _entries.end())
+            _entries.push_front(Entry{key, {}});
+        else
+            _entries.splice(_entries.begin(), _entries, it);
+
+        // Most recently used now, so it's the last to be evicted
+        it = _entries.begin();
+        it->idle.push_back(ctx);
+        ++_num_idle;
+
+        evict();
+    }
+
+    void ScalerCache::evict()
+    {
+        // Free the contexts of the least recently used conversions first,
+        // a conversion whose contexts are all leased out is added back on release
+        while (_num_idle > _max_idle && !_entries.empty())
+        {
+            auto &entry = _entries.back();
+
+            for (auto *ctx : entry.idle)
+                sws_freeContext(ctx);
+
+            _num_idle -= entry.idle.size();
+            _entries.pop_back();
+        }
+    }
+
+    ScalerCache &get_scaler_cache()
+    {
+        static ScalerCache cache{max_idle_scalers};
+
+        return cache;
+    }
+}
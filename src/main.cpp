@@ -17,6 +17,9 @@ int main(int argc, char **argv)
 
     core::app->run();
 
+    // Tear down before the process wide caches and pools it uses
+    core::app.reset();
+
     return 0;
 }
 
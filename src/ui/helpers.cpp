@@ -23,6 +23,25 @@ namespace ui
                 workspace.start_preview();
         }
 
+        // Shuttle, J plays backwards, K pauses, L plays forward
+        if (ImGui::IsKeyPressed(ImGuiKey_J, false)) {
+            LOG_DEBUG(logger, "J pressed");
+
+            workspace.start_preview(true);
+        }
+
+        if (ImGui::IsKeyPressed(ImGuiKey_K, false)) {
+            LOG_DEBUG(logger, "K pressed");
+
+            workspace.stop_preview();
+        }
+
+        if (ImGui::IsKeyPressed(ImGuiKey_L, false)) {
+            LOG_DEBUG(logger, "L pressed");
+
+            workspace.start_preview(false);
+        }
+
         // Seek backwards
         if (ImGui::IsKeyPressed(ImGuiKey_LeftArrow)) {
             LOG_DEBUG(logger, "Left pressed");
@@ -34,7 +34,20 @@ namespace ui
                 }
                 else if (const auto *file = std::get_if<core::io::File>(&ent))
                 {
-                    if (ImGui::TreeNodeEx(file->path.filename().c_str(), node_flags) && ImGui::IsItemClicked()) {
+                    const bool clicked = ImGui::TreeNodeEx(file->path.filename().c_str(), node_flags) && ImGui::IsItemClicked();
+
+                    // Poster frame, decoded in the background on first hover
+                    if (ImGui::IsItemHovered())
+                    {
+                        ImGui::BeginTooltip();
+
+                        if (!_window._thumbnail_textures.image(file->path, 0s, {core::ThumbnailStore::max_width, core::ThumbnailStore::max_height}))
+                            ImGui::TextUnformatted("...");
+
+                        ImGui::EndTooltip();
+                    }
+
+                    if (clicked) {
                         auto &workspace = core::app->get_workspace();
                         workspace.add_clip(file->open());
                     }
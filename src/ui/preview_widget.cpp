@@ -129,14 +129,14 @@ namespace ui
 
             if (_preview->last_frame && frame_updated)
             {
-                auto *frame = _preview->last_frame;
+                auto *frame = _preview->last_frame.get();
                 _cb_user.img_size.x = frame->width;
                 _cb_user.img_size.y = frame->height;
 
                 LOG_TRACE_L2(logger, "Updating preview texture, pts = {}, img_size=({}, {})", frame->pts, frame->width, frame->height);
 
                 glBindTexture(GL_TEXTURE_2D, _cb_user.texture);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, frame->width, frame->height, 0, GL_RGB, GL_UNSIGNED_BYTE, frame->data[0]);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame->width, frame->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame->data[0]);
             }
 
             _cb_user.active_clip = nullptr;
@@ -179,6 +179,16 @@ namespace ui
                                 const auto s = (delta.y / win_size.y) * 0.5;
                                 active_track.scale_clip(clip, s, s);
                             }
+                            else if (ImGui::IsKeyDown(ImGuiKey_LeftShift))
+                            {
+                                // Dragging up makes the clip more opaque
+                                active_track.fade_clip(clip, -delta.y / win_size.y);
+                            }
+                            else if (ImGui::IsKeyDown(ImGuiKey_LeftAlt))
+                            {
+                                // Dragging across the whole preview turns the clip half way around
+                                active_track.rotate_clip(clip, (delta.x / win_size.x) * 180.0f);
+                            }
                             else
                             {
                                 active_track.translate_clip(clip, delta.x / win_size.x, delta.y / win_size.y);
@@ -249,6 +259,22 @@ namespace ui
             draw_list->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
             draw_list->PopClipRect();
 
+            // Nothing composed yet, show the stored thumbnail of the clip under the cursor meanwhile
+            if (!_preview->last_frame)
+            {
+                auto &active_track = _workspace.get_timeline().get_track(_workspace.get_active_track_id());
+
+                if (const auto clip_id = active_track.clip_at(_workspace.get_cursor()))
+                {
+                    const auto &clip = active_track.clips[*clip_id];
+                    const auto ts = _workspace.get_cursor() - clip.position + clip.start_time;
+                    const auto win_pos = ImGui::GetWindowPos();
+                    const auto win_size = ImGui::GetWindowSize();
+
+                    _window._thumbnail_textures.draw(draw_list, clip.file.path, ts, win_pos, {win_pos.x + win_size.x, win_pos.y + win_size.y});
+                }
+            }
+
             _cb_user.win_pos = ImGui::GetWindowPos();
             _cb_user.win_size = ImGui::GetWindowSize();
             _cb_user.vp_size = ImGui::GetMainViewport()->WorkSize;
@@ -269,12 +295,11 @@ namespace ui
         in_seek.close();
         in_track_events.close();
 
+        // Queued frames are released along with the channel
         while (!out_frames.empty())
         {
             PreviewFrame frame;
             out_frames >> frame;
-            
-            av_frame_unref(frame.second);
         }
 
         out_frames.close();
@@ -290,6 +315,15 @@ namespace ui
     LivePreviewWorker::LivePreviewWorker(core::Timeline &timeline, const core::WorkspaceProperties &props):
         _composer(timeline, props)
     {
+        // Keeps decoder hiccups from showing up as dropped preview frames
+        _composer.set_read_ahead(true);
+
+        // Scrubbing keeps returning to the same frames
+        _composer.set_memoize(true);
+
+        // Dragging clips around only redraws what they move over
+        _composer.set_retain_layers(true);
+
         start();
     }
 
@@ -304,8 +338,8 @@ namespace ui
 
             LOG_DEBUG(logger, "Submitting seek request, seek_id = {}, cursor = {}", seek_id + 1, cursor / 1.0s);
 
-            in_seek << PreviewWorker::SeekRequest{++seek_id, cursor};
-            last_frame = nullptr;
+            in_seek << PreviewWorker::SeekRequest{++seek_id, cursor, workspace.is_preview_reversed()};
+            last_frame.reset();
         }
 
         bool should_pull_frame = !last_frame;
@@ -314,7 +348,7 @@ namespace ui
         if (workspace.is_preview_active())
         {
             // If current frame has ended, ask for a new one
-            if (const auto *frame = last_frame)
+            if (const auto *frame = last_frame.get())
             {
                 if (!last_frame_display_time.has_value())
                 {
@@ -353,15 +387,11 @@ namespace ui
                 if (frame.first < seek_id)
                 {
                     LOG_TRACE_L1(logger, "Frame fetched and discarded");
-                    av_frame_unref(frame.second);
                 }
                 else
                 {
-                    if (last_frame)
-                        av_frame_unref(last_frame);
-
                     LOG_TRACE_L1(logger, "Frame fetched and replaced as latest, pts = {}", frame.second->pts);
-                    last_frame = frame.second;
+                    last_frame = std::move(frame.second);
                     workspace.set_cursor(core::timestamp{last_frame->pts}, false);
 
                     if (!last_frame_display_time.has_value())
@@ -392,16 +422,17 @@ namespace ui
 
         for (auto seek_req : in_seek)
         {
-            LOG_DEBUG(logger, "Received seek request, seek_id = {}, cursor = {}", seek_req.first, seek_req.second.count());
+            LOG_DEBUG(logger, "Received seek request, seek_id = {}, cursor = {}", seek_req.seek_id, seek_req.position.count());
 
             // Drop all but the latest request for best latency
             while (!in_seek.empty())
             {
                 in_seek >> seek_req;
-                LOG_DEBUG(logger, "Have newer seek request, seek_id = {}, cursor = {}", seek_req.first, seek_req.second.count());
+                LOG_DEBUG(logger, "Have newer seek request, seek_id = {}, cursor = {}", seek_req.seek_id, seek_req.position.count());
             }
 
-            const auto &[seek_id, position] = seek_req;
+            const auto &[seek_id, position, reverse] = seek_req;
+            _composer.set_reverse(reverse);
             _composer.seek(position);
 
             while (in_seek.empty() && !in_seek.closed())
@@ -425,10 +456,12 @@ namespace ui
                     }
                 }
 
-                auto *frame = _composer.next_frame(AVMEDIA_TYPE_VIDEO);
-                LOG_DEBUG(logger, "Frame ready, pts = {}", frame->pts);
-                out_frames << PreviewFrame{seek_id, frame};
-                LOG_DEBUG(logger, "Frame sent, pts = {}", frame->pts);
+                auto frame = _composer.next_frame(AVMEDIA_TYPE_VIDEO);
+                const auto pts = frame->pts;
+
+                LOG_DEBUG(logger, "Frame ready, pts = {}", pts);
+                out_frames << PreviewFrame{seek_id, std::move(frame)};
+                LOG_DEBUG(logger, "Frame sent, pts = {}", pts);
             }
         }
 
@@ -438,12 +471,14 @@ namespace ui
     RenderPreviewWorker::RenderPreviewWorker(std::unique_ptr<core::RenderSession> &render_session):
         _render_session(render_session)
     {
-        _render_session->frame_ready_event.add_callback([this](auto *frame){
-            _ready_frames << frame;
+        // Shares the frame data with the encoder, nothing is copied
+        _render_session->frame_ready_event.add_callback([this](const core::FrameRef &frame){
+            _ready_frames << frame.share();
         });
 
+        // An empty frame marks the end
         _render_session->finished_event.add_callback([this](){
-            _ready_frames << (AVFrame*)nullptr;
+            _ready_frames << core::FrameRef{};
         });
 
         start();
@@ -458,10 +493,7 @@ namespace ui
             PreviewFrame frame;
             out_frames >> frame;
 
-            if (last_frame)
-                av_frame_unref(last_frame);
-
-            last_frame = frame.second;
+            last_frame = std::move(frame.second);
             workspace.set_cursor(core::timestamp{last_frame->pts}, false);
 
             return true;
@@ -472,16 +504,32 @@ namespace ui
 
     void RenderPreviewWorker::run()
     {
-        for (auto *frame : _ready_frames)
+        while (1)
         {
-            if (frame == nullptr)
+            core::FrameRef frame;
+            _ready_frames >> frame;
+
+            // Encoding outpaces the display, converting the frames that came
+            // in while the last one was shown would be wasted work
+            while (frame && !_ready_frames.empty())
+                _ready_frames >> frame;
+
+            if (!frame)
             {
-                // This destroys the RenderSession and joins the thread
+                // This destroys the RenderSession and joins its threads
                 _render_session.reset();
                 break;
             }
 
-            out_frames << PreviewFrame{0, frame};
+            if (frame->format != AV_PIX_FMT_RGBA)
+            {
+                core::FrameRef rgba{_display_converter.convert(frame.get(), frame->width, frame->height)};
+                av_frame_copy_props(rgba.get(), frame.get());
+
+                frame = std::move(rgba);
+            }
+
+            out_frames << PreviewFrame{0, std::move(frame)};
         }
 
         out_frames.close();
@@ -0,0 +1,67 @@
+#include "ui/thumbnail_textures.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace ui
+{
+    static std::pair<ImVec2, ImVec2> fit_rect(const core::ThumbnailStore::Thumbnail &thumbnail, ImVec2 min, ImVec2 max)
+    {
+        const float w = max.x - min.x;
+        const float h = max.y - min.y;
+        const float scale = std::min(w / thumbnail.width, h / thumbnail.height);
+
+        const float img_w = thumbnail.width * scale;
+        const float img_h = thumbnail.height * scale;
+        const float x = min.x + (w - img_w) * 0.5f;
+        const float y = min.y + (h - img_h) * 0.5f;
+
+        return {{x, y}, {x + img_w, y + img_h}};
+    }
+
+    bool ThumbnailTextures::draw(ImDrawList *draw_list, const std::string &path, core::timestamp ts, ImVec2 min, ImVec2 max)
+    {
+        const auto thumbnail = core::get_thumbnail_store().get(path, ts);
+
+        if (!thumbnail)
+            return false;
+
+        const auto [img_min, img_max] = fit_rect(*thumbnail, min, max);
+        draw_list->AddImage(get_texture(*thumbnail), img_min, img_max);
+
+        return true;
+    }
+
+    bool ThumbnailTextures::image(const std::string &path, core::timestamp ts, ImVec2 size)
+    {
+        const auto thumbnail = core::get_thumbnail_store().get(path, ts);
+
+        if (!thumbnail)
+            return false;
+
+        const auto [img_min, img_max] = fit_rect(*thumbnail, {0, 0}, size);
+        ImGui::Image(get_texture(*thumbnail), {img_max.x - img_min.x, img_max.y - img_min.y});
+
+        return true;
+    }
+
+    ImTextureID ThumbnailTextures::get_texture(const core::ThumbnailStore::Thumbnail &thumbnail)
+    {
+        auto [it, inserted] = _textures.try_emplace(thumbnail.pixels, 0);
+
+        if (inserted)
+        {
+            glGenTextures(1, &it->second);
+            glBindTexture(GL_TEXTURE_2D, it->second);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            // Rows are tightly packed
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, thumbnail.width, thumbnail.height, 0, GL_RGB, GL_UNSIGNED_BYTE, thumbnail.pixels);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+
+        return (ImTextureID)(intptr_t)it->second;
+    }
+}
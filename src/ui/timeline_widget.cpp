@@ -3,11 +3,15 @@
 #include "ui/main_window.h"
 #include "ui/helpers.h"
 #include "core/application.h"
+#include "core/frame_cache.h"
+#include "core/proxy.h"
+#include "core/thumbnail_store.h"
 
 #include "fmt/format.h"
 #include "logging.h"
 #include "imgui.h"
 
+#include <cmath>
 #include <filesystem>
 
 auto logger = logging::get_logger("TimelineWidget");
@@ -49,6 +53,12 @@ namespace ui
             ImGui::SameLine();
             ImGui::Text("Clips in active track: %zu", active_track.clips.size());
 
+            ImGui::SameLine();
+            const auto cache_stats = core::get_frame_cache().get_stats();
+            ImGui::TextUnformatted(fmt::format("Frame cache: {}+{}/{}MB, hits: {}, misses: {}, evictions: {}",
+                cache_stats.bytes >> 20, cache_stats.reserved >> 20, core::get_frame_cache().get_budget() >> 20,
+                cache_stats.hits, cache_stats.misses, cache_stats.evictions).c_str());
+
             if (ImGui::Button("Add Track"))
             {
                 _timeline.add_track();
@@ -402,11 +412,47 @@ namespace ui
             // Clip rect
             draw_list->AddQuadFilled({clip_x, y}, {clip_x + clip_w, y}, {clip_x + clip_w, y + h}, {clip_x, y + h}, clip_color);
 
+            // Thumbnails along the visible part of the clip, inset so the clip color shows around them
+            const float inset = 3.0f;
+            const float thumb_h = h - inset * 2;
+            const float thumb_w = thumb_h * core::ThumbnailStore::max_width / core::ThumbnailStore::max_height;
+            const float visible_begin = std::max(clip_x, x);
+            const float visible_end = std::min(clip_x + clip_w, x + w);
+
+            draw_list->PushClipRect({clip_x + inset, y + inset}, {clip_x + clip_w - inset, y + h - inset}, true);
+
+            for (float tile_x = clip_x + std::floor((visible_begin - clip_x) / thumb_w) * thumb_w; tile_x < visible_end; tile_x += thumb_w)
+            {
+                const auto ts = (clip.file.type == core::MediaFile::STATIC_IMAGE)
+                    ? core::timestamp{0s}
+                    : clip.start_time + winpos_to_timestamp(tile_x - clip_x, parent_width);
+
+                _window._thumbnail_textures.draw(draw_list, clip.file.path, ts, {tile_x + inset, y + inset}, {tile_x + thumb_w - inset, y + h - inset});
+            }
+
+            draw_list->PopClipRect();
+
             // Clip filename
             std::filesystem::path path{clip.file.path};
             const auto [_, fontSize] = ImGui::CalcTextSize("");
             int padding = 8;
             draw_list->AddText({clip_x + padding, y + h - (fontSize * 2) - padding}, 0xffffffff, path.filename().c_str(), nullptr);
+
+            // Proxy generation status
+            if (const auto &proxy = clip.file.proxy)
+            {
+                std::string status;
+
+                switch (proxy->status)
+                {
+                case core::Proxy::QUEUED: status = "proxy queued"; break;
+                case core::Proxy::GENERATING: status = fmt::format("proxy {:.0f}%", proxy->progress * 100.0f); break;
+                case core::Proxy::READY: status = "proxy"; break;
+                case core::Proxy::FAILED: status = "proxy failed"; break;
+                }
+
+                draw_list->AddText({clip_x + padding, y + padding}, 0xffaaaaaa, status.c_str(), nullptr);
+            }
         }
     }
 }
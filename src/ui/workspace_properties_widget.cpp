@@ -34,6 +34,8 @@ namespace ui
             ImGui::InputInt("Video width", &_props.video.width);
             ImGui::InputInt("Video height", &_props.video.height);
             ImGui::InputInt("Frame rate", &_props.video.fps);
+            ImGui::Checkbox("Preview using proxies", &_props.prefer_proxies);
+            ImGui::InputInt("Decode threads (0 = auto)", &_props.decode_threads);
 
             ImGui::Separator();
             ImGui::Columns(2);